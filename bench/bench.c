@@ -0,0 +1,1203 @@
+#include <c-string.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+/* Usage: bench [--csv | --json | --text] [--large] [filter]
+ * Runs every benchmark whose name contains 'filter' and prints one
+ * record per benchmark. CSV is the default output format. --large adds
+ * the 1 GB rope benchmarks, which need about 3 GB of memory. */
+
+/* The bench target is linked with -Wl,--wrap for the allocator functions,
+ * so every allocation made by the library goes through these counters.
+ * They are per thread so that counting does not make threads contend.
+ * Worker threads hand theirs to the main thread with add_counters(). */
+_Thread_local ulong num_allocs = 0;
+_Thread_local ulong num_reallocs = 0;
+_Thread_local ulong num_frees = 0;
+
+typedef struct counters {
+	ulong allocs;
+	ulong reallocs;
+	ulong frees;
+} counters_t;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+void *__wrap_malloc(size_t size) {
+	num_allocs++;
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size) {
+	num_allocs++;
+	return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+	num_reallocs++;
+	return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void *ptr) {
+	if (ptr) num_frees++;
+	__real_free(ptr);
+}
+
+typedef enum format {
+	FORMAT_CSV,
+	FORMAT_JSON,
+	FORMAT_TEXT
+} format_t;
+
+format_t format = FORMAT_CSV;
+const char *filter = NULL;
+bool run_large = false;
+uint num_reported = 0;
+
+/* Keeps the compiler from optimising away the baselines. */
+volatile ulong sink = 0;
+
+static double now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static bool selected(const char *name) {
+	return !filter || strstr(name, filter);
+}
+
+static void reset_counters() {
+	num_allocs = 0;
+	num_reallocs = 0;
+	num_frees = 0;
+}
+
+static counters_t take_counters() {
+	return (counters_t){num_allocs, num_reallocs, num_frees};
+}
+
+static void add_counters(const counters_t *counters) {
+	num_allocs += counters->allocs;
+	num_reallocs += counters->reallocs;
+	num_frees += counters->frees;
+}
+
+static void print_header() {
+	switch (format) {
+	case FORMAT_CSV:
+		printf("name,ops,bytes,ns_per_op,mb_per_s,allocs_per_op,reallocs_per_op,frees_per_op\n");
+		break;
+	case FORMAT_JSON:
+		printf("[\n");
+		break;
+	case FORMAT_TEXT:
+		break;
+	}
+}
+
+static void print_footer() {
+	if (format == FORMAT_JSON) printf("\n]\n");
+}
+
+/* Prints one record. 'bytes' is the amount of payload processed in total
+ * and may be 0 for benchmarks where throughput makes no sense. */
+static void report(const char *name, ulong ops, ulong bytes, double elapsed_ns) {
+	double ns_per_op = elapsed_ns / (double)ops;
+	double mb_per_s = (double)bytes / (elapsed_ns / 1e9) / 1e6;
+	double allocs_per_op = (double)num_allocs / (double)ops;
+	double reallocs_per_op = (double)num_reallocs / (double)ops;
+	double frees_per_op = (double)num_frees / (double)ops;
+
+	switch (format) {
+	case FORMAT_CSV:
+		printf("%s,%lu,%lu,%.2f,%.2f,%.3f,%.3f,%.3f\n",
+			name, ops, bytes, ns_per_op, mb_per_s,
+			allocs_per_op, reallocs_per_op, frees_per_op);
+		break;
+	case FORMAT_JSON:
+		printf("%s\t{\"name\": \"%s\", \"ops\": %lu, \"bytes\": %lu, "
+			"\"ns_per_op\": %.2f, \"mb_per_s\": %.2f, \"allocs_per_op\": %.3f, "
+			"\"reallocs_per_op\": %.3f, \"frees_per_op\": %.3f}",
+			num_reported ? ",\n" : "", name, ops, bytes, ns_per_op, mb_per_s,
+			allocs_per_op, reallocs_per_op, frees_per_op);
+		break;
+	case FORMAT_TEXT:
+		printf("%-36s %14.1f ns/op %10.1f MB/s %8.2f allocs/op %8.2f reallocs/op\n",
+			name, ns_per_op, mb_per_s, allocs_per_op, reallocs_per_op);
+		break;
+	}
+	fflush(stdout);
+	num_reported++;
+}
+
+// Builds a string of 'size' bytes out of 'filler', with 'needle'
+// placed every 'stride' bytes.
+int make_input(str_t *str, ulong size, const char *filler, const char *needle, ulong stride) {
+	ulong next_needle = stride;
+	while (str_len(str) < size) {
+		if (str_len(str) >= next_needle) {
+			str_append(str, needle);
+			next_needle += stride;
+		} else {
+			str_append(str, filler);
+		}
+	}
+	return 0;
+}
+
+// Benchmarks
+//// Construction
+int bench_create_destroy(const char *name, const char *text, ulong ops) {
+	if (!selected(name)) return 0;
+
+	reset_counters();
+	double start = now_ns();
+	for (ulong i = 0; i < ops; i++) {
+		str_auto str = str_new(text);
+		if (str_len(str) != strlen(text)) return -1;
+	}
+	report(name, ops, ops * strlen(text), now_ns() - start);
+	return 0;
+}
+
+// Hands a copy of a 'size' byte payload to 'consumers' consumers that
+// only read it, either by cloning or by copying it into a new string.
+int bench_fan_out(const char *name, ulong size, bool use_clone, ulong consumers) {
+	if (!selected(name)) return 0;
+
+	str_auto payload = str_new();
+	for (ulong i = 0; i < size; i++) str_push(payload, (char)('a' + i % 26));
+	str_t **copies = calloc(consumers, sizeof(str_t*));
+	if (!copies) return STR_ALLOC_ERROR;
+
+	reset_counters();
+	double start = now_ns();
+	for (ulong i = 0; i < consumers; i++) {
+		if (use_clone) {
+			TRY(str_clone_fn(payload, &copies[i]));
+		} else {
+			TRY(create_str(&copies[i]));
+			TRY(str_append_str_fn(copies[i], payload));
+		}
+	}
+	for (ulong i = 0; i < consumers; i++) str_destroy(&copies[i]);
+	report(name, consumers, consumers * size, now_ns() - start);
+
+	free(copies);
+	return 0;
+}
+
+// Builds a string out of 'num_parts' pieces, either with one append per
+// piece or with a single append_many().
+int bench_pieces(const char *name, bool use_many, ulong ops) {
+	if (!selected(name)) return 0;
+
+	const char *parts[] = {
+		"GET ", "/api/v1/users/42/profile", " HTTP/1.1", "\r\n",
+		"Host: ", "example.com", "\r\n", "Accept: ", "application/json"
+	};
+	const ulong num_parts = sizeof(parts) / sizeof(char*);
+
+	reset_counters();
+	double start = now_ns();
+	for (ulong i = 0; i < ops; i++) {
+		str_auto str = str_new();
+		if (use_many) {
+			TRY(str_append_many_fn(str, parts, num_parts));
+		} else {
+			for (ulong j = 0; j < num_parts; j++) str_append(str, parts[j]);
+		}
+		sink = str_len(str);
+	}
+	report(name, ops, ops * sink, now_ns() - start);
+	return 0;
+}
+
+// Creates and destroys short strings on several threads at once. Nothing
+// is shared between the threads, so the time per operation should stay
+// flat as threads are added.
+typedef struct create_destroy_worker {
+	ulong ops;
+	int status;
+	counters_t counters;
+} create_destroy_worker_t;
+
+static int create_destroy_loop(create_destroy_worker_t *worker) {
+	for (ulong i = 0; i < worker->ops; i++) {
+		str_auto str = str_new("X-Request-Id");
+		sink = str_len(str);
+	}
+	return 0;
+}
+
+static void *create_destroy_worker(void *arg) {
+	create_destroy_worker_t *worker = arg;
+	worker->status = create_destroy_loop(worker);
+	worker->counters = take_counters();
+	return NULL;
+}
+
+int bench_create_destroy_threads(uint num_threads, ulong ops_per_thread) {
+	char name[64];
+	snprintf(name, sizeof(name), "create_destroy_threads/%u", num_threads);
+	if (!selected(name)) return 0;
+
+	create_destroy_worker_t workers[64];
+	pthread_t threads[64];
+
+	reset_counters();
+	double start = now_ns();
+	for (uint i = 0; i < num_threads; i++) {
+		workers[i] = (create_destroy_worker_t){.ops = ops_per_thread};
+		if (pthread_create(&threads[i], NULL, create_destroy_worker, &workers[i])) {
+			return -1;
+		}
+	}
+	for (uint i = 0; i < num_threads; i++) {
+		pthread_join(threads[i], NULL);
+		add_counters(&workers[i].counters);
+	}
+	report(name, num_threads * ops_per_thread, 0, now_ns() - start);
+
+	for (uint i = 0; i < num_threads; i++) TRY(workers[i].status);
+	return 0;
+}
+
+// Simulates a request that builds 'strings_per_request' short strings and
+// frees them at the end, either one by one or by resetting an arena.
+int bench_request(const char *name, bool use_arena, ulong requests) {
+	if (!selected(name)) return 0;
+
+	const ulong strings_per_request = 1000;
+	str_t *strs[1000] = {0};
+	str_arena_t *arena = NULL;
+	if (use_arena) TRY(create_str_arena(&arena, 256 * 1024));
+	const str_allocator_t *allocator = arena ? str_arena_allocator(arena) : NULL;
+
+	reset_counters();
+	double start = now_ns();
+	for (ulong r = 0; r < requests; r++) {
+		for (ulong i = 0; i < strings_per_request; i++) {
+			if (allocator) {
+				TRY(create_str_with_allocator(&strs[i], allocator));
+			} else {
+				TRY(create_str(&strs[i]));
+			}
+			TRY(str_append_fn(strs[i], "X-Forwarded-For: 10.0.0.1"));
+		}
+		if (arena) {
+			str_arena_reset(arena);
+			for (ulong i = 0; i < strings_per_request; i++) strs[i] = NULL;
+		} else {
+			for (ulong i = 0; i < strings_per_request; i++) str_destroy(&strs[i]);
+		}
+	}
+	report(name, requests * strings_per_request, 0, now_ns() - start);
+
+	str_arena_destroy(&arena);
+	return 0;
+}
+
+//// Appending
+// Appends 'chunk_size' bytes at a time, clearing the string whenever it
+// reaches 1 MB so the capacity is reused.
+int bench_append(const char *name, ulong chunk_size, ulong total) {
+	if (!selected(name)) return 0;
+
+	char *chunk = malloc(chunk_size);
+	if (!chunk) return STR_ALLOC_ERROR;
+	memset(chunk, 'a', chunk_size);
+	str_auto str = str_new();
+	const ulong ops = total / chunk_size;
+
+	reset_counters();
+	double start = now_ns();
+	for (ulong i = 0; i < ops; i++) {
+		str_append_n(str, chunk, chunk_size);
+		if (str_len(str) >= 1024 * 1024) str_clear(str);
+	}
+	report(name, ops, ops * chunk_size, now_ns() - start);
+
+	free(chunk);
+	return 0;
+}
+
+// Same access pattern as bench_append() into a preallocated buffer.
+int bench_baseline_memcpy(const char *name, ulong chunk_size, ulong total) {
+	if (!selected(name)) return 0;
+
+	const ulong buffer_size = 1024 * 1024 + chunk_size + 1;
+	char *chunk = malloc(chunk_size);
+	char *buffer = malloc(buffer_size);
+	if (!chunk || !buffer) return STR_ALLOC_ERROR;
+	memset(chunk, 'a', chunk_size);
+	const ulong ops = total / chunk_size;
+
+	reset_counters();
+	double start = now_ns();
+	ulong len = 0;
+	for (ulong i = 0; i < ops; i++) {
+		memcpy(&buffer[len], chunk, chunk_size);
+		len += chunk_size;
+		buffer[len] = '\0';
+		if (len >= 1024 * 1024) len = 0;
+	}
+	sink = len + (ulong)buffer[0];
+	report(name, ops, ops * chunk_size, now_ns() - start);
+
+	free(chunk);
+	free(buffer);
+	return 0;
+}
+
+//// Formatting
+typedef enum format_path {
+	FORMAT_PATH_SNPRINTF,
+	FORMAT_PATH_APPENDF,
+	FORMAT_PATH_APPEND_UINT
+} format_path_t;
+
+// Serialises 'ops' metric samples of the form "requests_total 12345\n"
+// into a string that is cleared every 1000 samples.
+int bench_format(const char *name, format_path_t path, ulong ops) {
+	if (!selected(name)) return 0;
+
+	str_auto str = str_new();
+	ulong bytes = 0;
+
+	reset_counters();
+	double start = now_ns();
+	for (ulong i = 0; i < ops; i++) {
+		ulong value = i * 7919;
+		switch (path) {
+		case FORMAT_PATH_SNPRINTF: {
+			char buf[64];
+			int len = snprintf(buf, sizeof(buf), "requests_total %lu\n", value);
+			str_append_n(str, buf, (ulong)len);
+			break;
+		}
+		case FORMAT_PATH_APPENDF:
+			str_appendf(str, "requests_total %lu\n", value);
+			break;
+		case FORMAT_PATH_APPEND_UINT:
+			str_append_n(str, "requests_total ", 15);
+			str_append_uint(str, value);
+			str_push(str, '\n');
+			break;
+		}
+		if (i % 1000 == 999) {
+			bytes += str_len(str);
+			str_clear(str);
+		}
+	}
+	bytes += str_len(str);
+	report(name, ops, bytes, now_ns() - start);
+	return 0;
+}
+
+//// Push and pop
+int bench_push_pop(const char *name, ulong count) {
+	if (!selected(name)) return 0;
+
+	str_auto str = str_new();
+
+	reset_counters();
+	double start = now_ns();
+	for (ulong i = 0; i < count; i++) str_push(str, 'x');
+	for (ulong i = 0; i < count; i++) {
+		if (str_pop(str) != 'x') return -1;
+	}
+	report(name, 2 * count, 2 * count, now_ns() - start);
+	return 0;
+}
+
+// Pushes and pops two characters at a time right across a power of two
+// boundary, the worst case for a policy that shrinks eagerly.
+int bench_push_pop_churn(const char *name, str_shrink_t shrink, ulong ops) {
+	if (!selected(name)) return 0;
+
+	str_auto str = str_new();
+	str_policy_t policy = {.growth_percent = 200, .shrink = shrink};
+	str_set_policy(str, &policy);
+	for (ulong i = 0; i < 510; i++) str_push(str, 'x');
+
+	reset_counters();
+	double start = now_ns();
+	for (ulong i = 0; i < ops; i++) {
+		str_push(str, 'x');
+		str_push(str, 'x');
+		if (str_pop(str) != 'x') return -1;
+		if (str_pop(str) != 'x') return -1;
+	}
+	report(name, ops, ops * 4, now_ns() - start);
+	return 0;
+}
+
+//// Replacing
+int bench_replace(
+	const char *name, ulong size, const char *needle, ulong stride, const char *replacement
+) {
+	if (!selected(name)) return 0;
+
+	str_auto str = str_new();
+	TRY(make_input(str, size, "abcdefghijklmnop", needle, stride));
+	ulong bytes = str_len(str);
+
+	reset_counters();
+	double start = now_ns();
+	str_replace(str, needle, replacement);
+	report(name, 1, bytes, now_ns() - start);
+	return 0;
+}
+
+// Masks 'num_tokens' forbidden tokens in a message, with one replace()
+// per token or with one replace_all_map() over a compiled matcher.
+int bench_sanitize(const char *name, bool use_matcher, ulong num_tokens, ulong size, ulong ops) {
+	if (!selected(name)) return 0;
+
+	char tokens[64][16];
+	const char *patterns[64];
+	const char *masks[64];
+	if (num_tokens > 64) return STR_INVALID_ARG;
+	for (ulong i = 0; i < num_tokens; i++) {
+		snprintf(tokens[i], sizeof(tokens[i]), "secret%02lu", i);
+		patterns[i] = tokens[i];
+		masks[i] = "[redacted]";
+	}
+	str_matcher_t *matcher = NULL;
+	TRY(create_str_matcher(&matcher, patterns, num_tokens));
+	str_auto message = str_new();
+	TRY(make_input(message, size, "user=bob action=login ", "secret07 ", 256));
+	str_auto str = str_new();
+
+	str_status_t status = STR_SUCCESS;
+	reset_counters();
+	double start = now_ns();
+	for (ulong i = 0; !status && i < ops; i++) {
+		status = str_clear_fn(str);
+		if (!status) status = str_append_str_fn(str, message);
+		if (use_matcher) {
+			if (!status) status = str_replace_all_map_fn(str, matcher, masks);
+		} else {
+			for (ulong j = 0; !status && j < num_tokens; j++) {
+				status = str_replace_fn(str, patterns[j], masks[j]);
+			}
+		}
+	}
+	report(name, ops, ops * str_len(message), now_ns() - start);
+
+	str_matcher_destroy(&matcher);
+	return status;
+}
+
+// Scans input that contains none of 'num_patterns' patterns, to show that
+// the cost per byte doesn't depend on the number of patterns.
+int bench_has_any(const char *name, ulong num_patterns, ulong size, ulong ops) {
+	if (!selected(name)) return 0;
+
+	char (*bufs)[32] = malloc(num_patterns * sizeof(*bufs));
+	const char **patterns = malloc(num_patterns * sizeof(char*));
+	if (!bufs || !patterns) return STR_ALLOC_ERROR;
+	for (ulong i = 0; i < num_patterns; i++) {
+		snprintf(bufs[i], sizeof(bufs[i]), "HTTP/%lu.%lu", i / 10 + 3, i % 10);
+		patterns[i] = bufs[i];
+	}
+	str_matcher_t *matcher = NULL;
+	str_status_t status = create_str_matcher(&matcher, patterns, num_patterns);
+	str_auto str = str_new();
+	TRY(make_input(str, size, "GET /index.html HTTP/1.1 200 ", "", size));
+
+	reset_counters();
+	double start = now_ns();
+	for (ulong i = 0; !status && i < ops; i++) {
+		bool has = false;
+		status = str_has_any_fn(str, matcher, &has);
+		if (has) status = -1;
+	}
+	report(name, ops, ops * str_len(str), now_ns() - start);
+
+	str_matcher_destroy(&matcher);
+	free(patterns);
+	free(bufs);
+	return status;
+}
+
+//// Searching
+int bench_has(const char *name, ulong size, const char *needle, ulong ops) {
+	if (!selected(name)) return 0;
+
+	str_auto str = str_new();
+	TRY(make_input(str, size, "GET /index.html HTTP/1.1 200 ", "", size));
+	ulong bytes = str_len(str);
+
+	reset_counters();
+	double start = now_ns();
+	for (ulong i = 0; i < ops; i++) {
+		if (str_has(str, needle)) return -1;
+	}
+	report(name, ops, ops * bytes, now_ns() - start);
+	return 0;
+}
+
+// Applies the same needle to many short strings, passing it as a plain
+// string every time or as a pattern prepared once.
+int bench_has_small(const char *name, bool use_pattern, const char *needle, ulong ops) {
+	if (!selected(name)) return 0;
+
+	str_pattern_t *pattern = NULL;
+	TRY(create_str_pattern(&pattern, needle));
+	str_auto str = str_new();
+	TRY(make_input(str, 256, "GET /index.html HTTP/1.1 200 ", "", 256));
+
+	str_status_t status = STR_SUCCESS;
+	reset_counters();
+	double start = now_ns();
+	for (ulong i = 0; !status && i < ops; i++) {
+		bool has = false;
+		status = use_pattern ?
+			str_has_pattern_fn(str, pattern, &has) : str_has_fn(str, needle, &has);
+		if (has) status = -1;
+	}
+	report(name, ops, ops * str_len(str), now_ns() - start);
+
+	str_pattern_destroy(&pattern);
+	return status;
+}
+
+int bench_baseline_strstr(const char *name, ulong size, const char *needle, ulong ops) {
+	if (!selected(name)) return 0;
+
+	str_auto str = str_new();
+	TRY(make_input(str, size, "GET /index.html HTTP/1.1 200 ", "", size));
+	ulong bytes = str_len(str);
+	const char *data = str_data(str);
+
+	reset_counters();
+	double start = now_ns();
+	for (ulong i = 0; i < ops; i++) {
+		if (strstr(data, needle)) return -1;
+	}
+	report(name, ops, ops * bytes, now_ns() - start);
+	return 0;
+}
+
+// Walks every match with str_find_from.
+int bench_find_all(const char *name, ulong size, ulong stride) {
+	if (!selected(name)) return 0;
+
+	str_auto str = str_new();
+	TRY(make_input(str, size, "abcdefghijklmnop", "fox", stride));
+	ulong bytes = str_len(str);
+
+	reset_counters();
+	double start = now_ns();
+	ulong count = 0;
+	ulong pos = str_find(str, "fox");
+	while (pos != STR_NPOS) {
+		count++;
+		pos = str_find_from(str, "fox", pos + 3);
+	}
+	sink = count;
+	report(name, 1, bytes, now_ns() - start);
+	return 0;
+}
+
+//// Splitting
+int bench_split(const char *name, ulong size, str_split_mode_t mode) {
+	if (!selected(name)) return 0;
+
+	str_auto str = str_new();
+	TRY(make_input(str, size, "field1,field2 field3\r\n", "", size));
+	ulong bytes = str_len(str);
+
+	reset_counters();
+	double start = now_ns();
+	str_split_t split;
+	switch (mode) {
+	case STR_SPLIT_BYTE: TRY(str_split_fn(str, ',', &split)); break;
+	case STR_SPLIT_BYTE_SET: TRY(str_split_any_fn(str, ", \r\n", &split)); break;
+	case STR_SPLIT_SEPARATOR: TRY(str_split_sep_fn(str, "\r\n", &split)); break;
+	}
+	str_view_t token;
+	ulong count = 0;
+	while (str_split_next(&split, &token)) count++;
+	sink = count;
+	report(name, count, bytes, now_ns() - start);
+	return 0;
+}
+
+//// Hashing and interning
+int bench_hash(const char *name, ulong size, ulong ops) {
+	if (!selected(name)) return 0;
+
+	str_auto str = str_new();
+	for (ulong i = 0; i < size; i++) str_push(str, (char)('a' + i % 26));
+	const char *data = str_data(str);
+
+	reset_counters();
+	double start = now_ns();
+	ulong hash = 0;
+	for (ulong i = 0; i < ops; i++) hash ^= str_hash_n(data, size);
+	sink = hash;
+	report(name, ops, ops * size, now_ns() - start);
+	return 0;
+}
+
+// Interns 'ops' keys drawn from 'num_keys' distinct header names.
+int bench_intern(const char *name, ulong num_keys, ulong ops) {
+	if (!selected(name)) return 0;
+
+	str_intern_t *intern = NULL;
+	TRY(create_str_intern(&intern));
+	char key[32];
+
+	reset_counters();
+	double start = now_ns();
+	for (ulong i = 0; i < ops; i++) {
+		int len = snprintf(key, sizeof(key), "x-header-%lu", i % num_keys);
+		const str_t *interned = NULL;
+		TRY(str_intern_n_fn(intern, key, (ulong)len, &interned));
+		sink = (ulong)interned;
+	}
+	report(name, ops, 0, now_ns() - start);
+
+	str_intern_destroy(&intern);
+	return 0;
+}
+
+// Interns from several threads at once. With 'global_lock' set, every call
+// is serialised by one mutex, which is what the sharded table avoids.
+#define INTERN_KEYS 4000
+
+typedef struct intern_worker {
+	str_intern_t *intern;
+	pthread_mutex_t *global_lock;
+	ulong ops;
+	ulong seed;
+	int status;
+	counters_t counters;
+} intern_worker_t;
+
+static void *intern_worker(void *arg) {
+	intern_worker_t *worker = arg;
+	char key[32];
+	ulong x = worker->seed;
+	for (ulong i = 0; i < worker->ops; i++) {
+		x = x * 6364136223846793005UL + 1442695040888963407UL;
+		int len = snprintf(key, sizeof(key), "x-header-%lu", (x >> 33) % INTERN_KEYS);
+		const str_t *interned = NULL;
+		if (worker->global_lock) pthread_mutex_lock(worker->global_lock);
+		worker->status = str_intern_n_fn(worker->intern, key, (ulong)len, &interned);
+		if (worker->global_lock) pthread_mutex_unlock(worker->global_lock);
+		if (worker->status) break;
+	}
+	worker->counters = take_counters();
+	return NULL;
+}
+
+int bench_intern_threads(bool global_lock, uint num_threads, ulong ops_per_thread) {
+	char name[64];
+	snprintf(name, sizeof(name), "intern_threads/%s/%u",
+		global_lock ? "global_lock" : "sharded", num_threads);
+	if (!selected(name)) return 0;
+
+	str_intern_t *intern = NULL;
+	TRY(create_str_intern(&intern));
+	pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+	intern_worker_t workers[64];
+	pthread_t threads[64];
+
+	// Every key is interned once up front, so the timed part measures the
+	// lookups a service does for every request.
+	intern_worker_t warmup = {.intern = intern, .ops = 8 * INTERN_KEYS, .seed = 1};
+	intern_worker(&warmup);
+	TRY(warmup.status);
+
+	reset_counters();
+	double start = now_ns();
+	for (uint i = 0; i < num_threads; i++) {
+		workers[i] = (intern_worker_t){
+			.intern = intern,
+			.global_lock = global_lock ? &lock : NULL,
+			.ops = ops_per_thread,
+			.seed = i + 1
+		};
+		if (pthread_create(&threads[i], NULL, intern_worker, &workers[i])) return -1;
+	}
+	for (uint i = 0; i < num_threads; i++) {
+		pthread_join(threads[i], NULL);
+		add_counters(&workers[i].counters);
+	}
+	report(name, num_threads * ops_per_thread, 0, now_ns() - start);
+
+	str_intern_destroy(&intern);
+	for (uint i = 0; i < num_threads; i++) TRY(workers[i].status);
+	return 0;
+}
+
+//// Comparing
+int bench_cmp(const char *name, ulong size, bool same_len, ulong ops) {
+	if (!selected(name)) return 0;
+
+	str_auto str = str_new();
+	char *pattern = malloc(size + 2);
+	if (!pattern) return STR_ALLOC_ERROR;
+	for (ulong i = 0; i < size; i++) {
+		str_push(str, (char)('a' + i % 26));
+		pattern[i] = (char)('a' + i % 26);
+	}
+	pattern[size] = same_len ? '\0' : 'x';
+	pattern[size + 1] = '\0';
+	ulong pattern_len = strlen(pattern);
+
+	reset_counters();
+	double start = now_ns();
+	for (ulong i = 0; i < ops; i++) {
+		if (str_equals_n(str, pattern, pattern_len) != same_len) return -1;
+	}
+	// Strings of different lengths are rejected without reading them, so
+	// only the time per call is meaningful there.
+	report(name, ops, same_len ? ops * size : 0, now_ns() - start);
+
+	free(pattern);
+	return 0;
+}
+
+int bench_baseline_memcmp(const char *name, ulong size, ulong ops) {
+	if (!selected(name)) return 0;
+
+	char *a = malloc(size);
+	char *b = malloc(size);
+	if (!a || !b) return STR_ALLOC_ERROR;
+	for (ulong i = 0; i < size; i++) {
+		a[i] = (char)('a' + i % 26);
+		b[i] = (char)('a' + i % 26);
+	}
+
+	reset_counters();
+	double start = now_ns();
+	ulong equal = 0;
+	for (ulong i = 0; i < ops; i++) {
+		equal += !memcmp(a, b, size);
+		sink = equal;
+	}
+	report(name, ops, ops * size, now_ns() - start);
+
+	free(a);
+	free(b);
+	return 0;
+}
+
+//// Clearing
+// Refills a scratch string after every clear, like a per-connection buffer.
+int bench_clear_refill(const char *name, ulong size, ulong ops) {
+	if (!selected(name)) return 0;
+
+	char *chunk = malloc(size);
+	if (!chunk) return STR_ALLOC_ERROR;
+	memset(chunk, 'a', size);
+	str_auto str = str_new();
+
+	reset_counters();
+	double start = now_ns();
+	for (ulong i = 0; i < ops; i++) {
+		str_append_n(str, chunk, size);
+		str_clear(str);
+	}
+	report(name, ops, ops * size, now_ns() - start);
+
+	free(chunk);
+	return 0;
+}
+
+// Reads a whole file into a fresh string, as a config or template loader
+// would. The file is written once and stays in the page cache.
+int bench_read_file(const char *name, ulong size, ulong ops) {
+	if (!selected(name)) return 0;
+
+	char path[] = "/tmp/c-string-bench-XXXXXX";
+	int fd = mkstemp(path);
+	if (fd < 0) return STR_IO_ERROR;
+	str_auto content = str_new();
+	for (ulong i = 0; i < size; i++) str_push(content, (char)('a' + i % 26));
+	str_status_t status = str_write_fd_fn(content, fd);
+	close(fd);
+
+	reset_counters();
+	double start = now_ns();
+	for (ulong i = 0; !status && i < ops; i++) {
+		str_t *str = NULL;
+		status = create_str(&str);
+		if (!status) status = str_read_file_fn(str, path);
+		str_destroy(&str);
+	}
+	report(name, ops, ops * size, now_ns() - start);
+
+	unlink(path);
+	return status;
+}
+
+// Sends a response made of a status line, headers and a body to
+// /dev/null, with one write per part or with one writev() for all three.
+int bench_write_response(const char *name, bool use_writev, ulong body_size, ulong ops) {
+	if (!selected(name)) return 0;
+
+	int fd = open("/dev/null", O_WRONLY);
+	if (fd < 0) return STR_IO_ERROR;
+	str_auto status_line = str_new("HTTP/1.1 200 OK\r\n");
+	str_auto headers = str_new();
+	str_appendf(headers, "Content-Length: %lu\r\n\r\n", body_size);
+	str_auto body = str_new();
+	for (ulong i = 0; i < body_size; i++) str_push(body, 'x');
+	ulong bytes = str_len(status_line) + str_len(headers) + body_size;
+
+	str_status_t status = STR_SUCCESS;
+	reset_counters();
+	double start = now_ns();
+	for (ulong i = 0; !status && i < ops; i++) {
+		if (use_writev) {
+			const str_t *parts[] = {status_line, headers, body};
+			status = str_writev_fd_fn(fd, parts, 3);
+		} else {
+			status = str_write_fd_fn(status_line, fd);
+			if (!status) status = str_write_fd_fn(headers, fd);
+			if (!status) status = str_write_fd_fn(body, fd);
+		}
+	}
+	report(name, ops, ops * bytes, now_ns() - start);
+
+	close(fd);
+	return status;
+}
+
+typedef enum line_path {
+	LINE_PATH_GETLINE,
+	LINE_PATH_VIEW,
+	LINE_PATH_INTO
+} line_path_t;
+
+// Reads a log file line by line. The getline() path copies every line
+// into a str_t the way callers did before the line reader existed.
+int bench_lines(const char *name, line_path_t path, ulong size) {
+	if (!selected(name)) return 0;
+
+	char file_path[] = "/tmp/c-string-bench-XXXXXX";
+	int fd = mkstemp(file_path);
+	if (fd < 0) return STR_IO_ERROR;
+	str_auto content = str_new();
+	for (ulong i = 0; str_len(content) < size; i++) {
+		str_appendf(content, "2025-01-01T00:00:00Z GET /api/items/%lu 200 %lu\n", i, i % 997);
+	}
+	str_status_t status = str_write_fd_fn(content, fd);
+	lseek(fd, 0, SEEK_SET);
+
+	str_auto line = str_new();
+	ulong num_lines = 0;
+	reset_counters();
+	double start = now_ns();
+	if (!status && path == LINE_PATH_GETLINE) {
+		FILE *file = fdopen(dup(fd), "r");
+		char *buf = NULL;
+		size_t buf_size = 0;
+		ssize_t len;
+		while (!status && (len = getline(&buf, &buf_size, file)) > 0) {
+			status = str_clear_fn(line);
+			if (!status) status = str_append_n_fn(line, buf, (ulong)len - 1);
+			num_lines++;
+		}
+		free(buf);
+		fclose(file);
+	} else if (!status) {
+		str_reader_t *reader = NULL;
+		status = create_str_reader(&reader, fd, 0);
+		bool has_line = !status;
+		while (has_line) {
+			if (path == LINE_PATH_VIEW) {
+				str_view_t view;
+				status = str_reader_next_fn(reader, &view, &has_line);
+			} else {
+				status = str_reader_next_into_fn(reader, line, &has_line);
+			}
+			if (status) break;
+			num_lines += has_line;
+		}
+		str_reader_destroy(&reader);
+	}
+	report(name, num_lines, str_len(content), now_ns() - start);
+
+	close(fd);
+	unlink(file_path);
+	return status;
+}
+
+//// Ropes
+// Assembles a document of 'size' bytes from 4 KB pieces.
+int bench_assemble(const char *name, bool use_rope, ulong size) {
+	if (!selected(name)) return 0;
+
+	char piece[4096];
+	memset(piece, 'x', sizeof(piece));
+	ulong ops = size / sizeof(piece);
+	str_t *str = NULL;
+	str_rope_t *rope = NULL;
+	str_status_t status = use_rope ? create_str_rope(&rope) : create_str(&str);
+
+	reset_counters();
+	double start = now_ns();
+	for (ulong i = 0; !status && i < ops; i++) {
+		status = use_rope ?
+			str_rope_append_n_fn(rope, piece, sizeof(piece)) :
+			str_append_n_fn(str, piece, sizeof(piece));
+	}
+	report(name, ops, size, now_ns() - start);
+
+	str_destroy(&str);
+	str_rope_destroy(&rope);
+	return status;
+}
+
+// Inserts 64 bytes at a random position and erases 64 bytes at another in
+// a document of 'size' bytes. str_t has no insert, so the plain version
+// builds the edited document in a new string, as callers do today.
+int bench_edit(const char *name, bool use_rope, ulong size, ulong ops) {
+	if (!selected(name)) return 0;
+
+	char *content = malloc(size);
+	if (!content) return STR_ALLOC_ERROR;
+	for (ulong i = 0; i < size; i++) content[i] = (char)('a' + i % 26);
+	const char piece[64] = "inserted";
+	str_t *str = NULL;
+	str_rope_t *rope = NULL;
+	str_status_t status = STR_SUCCESS;
+	if (use_rope) {
+		status = create_str_rope(&rope);
+		if (!status) status = str_rope_append_n_fn(rope, content, size);
+	} else {
+		status = create_str(&str);
+		if (!status) status = str_append_n_fn(str, content, size);
+	}
+	free(content);
+
+	srand(1);
+	reset_counters();
+	double start = now_ns();
+	for (ulong i = 0; !status && i < ops; i++) {
+		ulong insert_at = (ulong)rand() % size;
+		ulong erase_at = (ulong)rand() % size;
+		if (use_rope) {
+			status = str_rope_insert_n_fn(rope, insert_at, piece, sizeof(piece));
+			if (!status) status = str_rope_erase_fn(rope, erase_at, sizeof(piece));
+			continue;
+		}
+		const char *data = str_data(str);
+		str_t *edited = NULL;
+		status = create_str(&edited);
+		if (!status) status = str_reserve_fn(edited, size);
+		if (!status) status = str_append_n_fn(edited, data, insert_at);
+		if (!status) status = str_append_n_fn(edited, piece, sizeof(piece));
+		if (!status) status = str_append_n_fn(edited, data + insert_at, size - insert_at);
+		str_destroy(&str);
+		str = edited;
+		// The erase moves the tail down within the same string.
+		const char *tail = str_data(str) + erase_at + sizeof(piece);
+		str_t *trimmed = NULL;
+		if (!status) status = create_str(&trimmed);
+		if (!status) status = str_reserve_fn(trimmed, size);
+		if (!status) status = str_append_n_fn(trimmed, str_data(str), erase_at);
+		if (!status) status = str_append_n_fn(trimmed, tail, size - erase_at);
+		str_destroy(&str);
+		str = trimmed;
+	}
+	report(name, ops, ops * 2 * sizeof(piece), now_ns() - start);
+
+	str_destroy(&str);
+	str_rope_destroy(&rope);
+	return status;
+}
+
+// Copies a rope of 'size' bytes into one contiguous string.
+int bench_flatten(const char *name, ulong size) {
+	if (!selected(name)) return 0;
+
+	char piece[4096];
+	memset(piece, 'x', sizeof(piece));
+	str_rope_t *rope = NULL;
+	TRY(create_str_rope(&rope));
+	str_status_t status = STR_SUCCESS;
+	for (ulong i = 0; !status && i < size / sizeof(piece); i++) {
+		status = str_rope_append_n_fn(rope, piece, sizeof(piece));
+	}
+	str_t *str = NULL;
+	if (!status) status = create_str(&str);
+
+	reset_counters();
+	double start = now_ns();
+	if (!status) status = str_rope_flatten_fn(rope, str);
+	report(name, 1, size, now_ns() - start);
+
+	str_destroy(&str);
+	str_rope_destroy(&rope);
+	return status;
+}
+
+int run() {
+	const ulong kb = 1024;
+	const ulong mb = 1024 * 1024;
+	// Multi-threaded benchmarks double the thread count up to the number
+	// of online cores.
+	long num_cores = sysconf(_SC_NPROCESSORS_ONLN);
+	uint max_threads = num_cores < 1 ? 1 : num_cores > 64 ? 64 : (uint)num_cores;
+
+	TRY(bench_create_destroy("create_destroy/empty", "", 1000000));
+	TRY(bench_create_destroy("create_destroy/2B", "OK", 1000000));
+	TRY(bench_create_destroy("create_destroy/6B", "key-42", 1000000));
+	TRY(bench_create_destroy("create_destroy/15B", "fifteen bytes!!", 1000000));
+	TRY(bench_create_destroy("create_destroy/64B",
+		"a string that is too long for the inline buffer of the string..", 1000000));
+	TRY(bench_pieces("pieces/append_each", false, 1000000));
+	TRY(bench_pieces("pieces/append_many", true, 1000000));
+	for (uint threads = 1;; threads *= 2) {
+		if (threads > max_threads) threads = max_threads;
+		TRY(bench_create_destroy_threads(threads, 1000000));
+		if (threads == max_threads) break;
+	}
+	TRY(bench_fan_out("fan_out/copy/64KB", 64 * kb, false, 10000));
+	TRY(bench_fan_out("fan_out/clone/64KB", 64 * kb, true, 10000));
+	TRY(bench_request("request/malloc", false, 1000));
+	TRY(bench_request("request/arena", true, 1000));
+
+	TRY(bench_append("append/1B", 1, 16 * mb));
+	TRY(bench_append("append/16B", 16, 64 * mb));
+	TRY(bench_append("append/256B", 256, 256 * mb));
+	TRY(bench_append("append/4KB", 4 * kb, 256 * mb));
+	TRY(bench_append("append/64KB", 64 * kb, 256 * mb));
+	TRY(bench_baseline_memcpy("baseline/memcpy/1B", 1, 16 * mb));
+	TRY(bench_baseline_memcpy("baseline/memcpy/16B", 16, 64 * mb));
+	TRY(bench_baseline_memcpy("baseline/memcpy/256B", 256, 256 * mb));
+	TRY(bench_baseline_memcpy("baseline/memcpy/4KB", 4 * kb, 256 * mb));
+	TRY(bench_baseline_memcpy("baseline/memcpy/64KB", 64 * kb, 256 * mb));
+
+	TRY(bench_format("format/baseline_snprintf", FORMAT_PATH_SNPRINTF, 1000000));
+	TRY(bench_format("format/appendf", FORMAT_PATH_APPENDF, 1000000));
+	TRY(bench_format("format/append_uint", FORMAT_PATH_APPEND_UINT, 1000000));
+
+	TRY(bench_push_pop("push_pop/1M", 1000000));
+	TRY(bench_push_pop_churn("push_pop_churn/eager", STR_SHRINK_EAGER, 1000000));
+	TRY(bench_push_pop_churn("push_pop_churn/hysteresis", STR_SHRINK_HYSTERESIS, 1000000));
+	TRY(bench_push_pop_churn("push_pop_churn/never", STR_SHRINK_NEVER, 1000000));
+
+	TRY(bench_replace("replace/dense_grow/1MB", mb, "fox", 32, "wolves"));
+	TRY(bench_replace("replace/dense_shrink/1MB", mb, "fox", 32, "ox"));
+	TRY(bench_replace("replace/sparse_grow/1MB", mb, "fox", 64 * kb, "wolves"));
+	TRY(bench_replace("replace/sparse_shrink/1MB", mb, "fox", 64 * kb, "ox"));
+	TRY(bench_replace("replace/dense_grow/10MB", 10 * mb, "fox", 32, "wolves"));
+	TRY(bench_replace("replace/dense_shrink/10MB", 10 * mb, "fox", 32, "ox"));
+	TRY(bench_replace("replace/sparse_grow/10MB", 10 * mb, "fox", 64 * kb, "wolves"));
+	TRY(bench_replace("replace/sparse_shrink/10MB", 10 * mb, "fox", 64 * kb, "ox"));
+	TRY(bench_replace("replace/dense_grow/100MB", 100 * mb, "fox", 32, "wolves"));
+	TRY(bench_replace("replace/dense_shrink/100MB", 100 * mb, "fox", 32, "ox"));
+	TRY(bench_replace("replace/sparse_grow/100MB", 100 * mb, "fox", 64 * kb, "wolves"));
+	TRY(bench_replace("replace/sparse_shrink/100MB", 100 * mb, "fox", 64 * kb, "ox"));
+	TRY(bench_sanitize("sanitize/replace_each/50_tokens/4KB", false, 50, 4 * kb, 10000));
+	TRY(bench_sanitize("sanitize/replace_all_map/50_tokens/4KB", true, 50, 4 * kb, 10000));
+
+	TRY(bench_has("has/miss/1MB", mb, "HTTP/2.0", 100));
+	TRY(bench_has("has/miss_rare_bytes/1MB", mb, "zq", 100));
+	TRY(bench_baseline_strstr("baseline/strstr/miss/1MB", mb, "HTTP/2.0", 100));
+	TRY(bench_baseline_strstr("baseline/strstr/miss_rare_bytes/1MB", mb, "zq", 100));
+	TRY(bench_find_all("find_all/dense/10MB", 10 * mb, 32));
+	TRY(bench_find_all("find_all/sparse/10MB", 10 * mb, 64 * kb));
+	TRY(bench_has_small("has_small/short/string", false, "HTTP/2.0", 1000000));
+	TRY(bench_has_small("has_small/short/pattern", true, "HTTP/2.0", 1000000));
+	TRY(bench_has_small("has_small/long/string", false,
+		"HTTP/1.1 200 GET /index.html HTTP/1.1 500 ", 1000000));
+	TRY(bench_has_small("has_small/long/pattern", true,
+		"HTTP/1.1 200 GET /index.html HTTP/1.1 500 ", 1000000));
+	TRY(bench_has_any("has_any/5_patterns/1MB", 5, mb, 100));
+	TRY(bench_has_any("has_any/50_patterns/1MB", 50, mb, 100));
+	TRY(bench_has_any("has_any/500_patterns/1MB", 500, mb, 100));
+
+	TRY(bench_split("split/byte/10MB", 10 * mb, STR_SPLIT_BYTE));
+	TRY(bench_split("split/byte_set/10MB", 10 * mb, STR_SPLIT_BYTE_SET));
+	TRY(bench_split("split/separator/10MB", 10 * mb, STR_SPLIT_SEPARATOR));
+
+	TRY(bench_hash("hash/16B", 16, 10000000));
+	TRY(bench_hash("hash/64B", 64, 10000000));
+	TRY(bench_hash("hash/4KB", 4 * kb, 100000));
+	TRY(bench_intern("intern/100_keys", 100, 1000000));
+	TRY(bench_intern("intern/100K_keys", 100000, 1000000));
+	for (uint threads = 1;; threads *= 2) {
+		if (threads > max_threads) threads = max_threads;
+		TRY(bench_intern_threads(false, threads, 1000000));
+		TRY(bench_intern_threads(true, threads, 1000000));
+		if (threads == max_threads) break;
+	}
+
+	TRY(bench_cmp("cmp/equal/1KB", kb, true, 1000000));
+	TRY(bench_cmp("cmp/length_differs/1KB", kb, false, 1000000));
+	TRY(bench_baseline_memcmp("baseline/memcmp/1KB", kb, 1000000));
+
+	TRY(bench_clear_refill("clear_refill/4KB", 4 * kb, 1000000));
+
+	TRY(bench_read_file("read_file/4KB", 4 * kb, 100000));
+	TRY(bench_read_file("read_file/1MB", mb, 1000));
+	TRY(bench_read_file("read_file/64MB", 64 * mb, 10));
+	TRY(bench_write_response("write_response/write/1KB", false, kb, 1000000));
+	TRY(bench_write_response("write_response/writev/1KB", true, kb, 1000000));
+	TRY(bench_lines("lines/baseline_getline/64MB", LINE_PATH_GETLINE, 64 * mb));
+	TRY(bench_lines("lines/reader_view/64MB", LINE_PATH_VIEW, 64 * mb));
+	TRY(bench_lines("lines/reader_into/64MB", LINE_PATH_INTO, 64 * mb));
+
+	const ulong rope_sizes[] = {mb, 100 * mb, 1024 * mb};
+	const char *rope_size_names[] = {"1MB", "100MB", "1GB"};
+	const ulong str_edit_ops[] = {1000, 10, 2};
+	for (uint i = 0; i < 3; i++) {
+		if (rope_sizes[i] > 100 * mb && !run_large) break;
+		char name[64];
+		snprintf(name, sizeof(name), "assemble/str/%s", rope_size_names[i]);
+		TRY(bench_assemble(name, false, rope_sizes[i]));
+		snprintf(name, sizeof(name), "assemble/rope/%s", rope_size_names[i]);
+		TRY(bench_assemble(name, true, rope_sizes[i]));
+		snprintf(name, sizeof(name), "edit/str/%s", rope_size_names[i]);
+		TRY(bench_edit(name, false, rope_sizes[i], str_edit_ops[i]));
+		snprintf(name, sizeof(name), "edit/rope/%s", rope_size_names[i]);
+		TRY(bench_edit(name, true, rope_sizes[i], 100000));
+		snprintf(name, sizeof(name), "flatten/rope/%s", rope_size_names[i]);
+		TRY(bench_flatten(name, rope_sizes[i]));
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--csv")) {
+			format = FORMAT_CSV;
+		} else if (!strcmp(argv[i], "--json")) {
+			format = FORMAT_JSON;
+		} else if (!strcmp(argv[i], "--text")) {
+			format = FORMAT_TEXT;
+		} else if (!strcmp(argv[i], "--large")) {
+			run_large = true;
+		} else {
+			filter = argv[i];
+		}
+	}
+
+	print_header();
+	int status = run();
+	print_footer();
+
+	if (status) fprintf(stderr, "Benchmark failed with status %d\n", status);
+	return status;
+}
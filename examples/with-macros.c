@@ -1,4 +1,5 @@
 #include <c-string.h>
+#include <string.h>
 
 // All macros are designed to return from the caller function with the
 // appropriate status code upon failure.
@@ -24,6 +25,19 @@ int main(void) {
 	
 	str_t *manual_str = str_new("Don't forget to free me!");
 
+	// Creates a copy of 'str'. Long content is shared until one of the
+	// two strings is modified, so cloning is O(1).
+	str_auto clone = str_clone(str);
+
+	// Takes over a malloc()ed buffer without copying it...
+	char *buf = malloc(64);
+	memcpy(buf, "raw bytes", 9);
+	str_auto owned = str_from_owned(buf, 9, 64);
+	// ...and hands it back. 'owned' is left empty and 'buf' must be freed.
+	ulong buf_len = 0;
+	buf = str_detach(owned, &buf_len, NULL);
+	free(buf);
+
 	// note: this needs to be freed explicitly with the following function:
 	str_destroy(&manual_str);
 
@@ -31,6 +45,23 @@ int main(void) {
 	
 	// Appends 'src' at the end of 'str'.
 	str_append(str, " This is a new library");
+	// Appends the first 5 bytes of 'src'. The bytes may include '\0'.
+	str_append_n(str, " and then some", 5);
+	// Appends the content of another string object.
+	str_append_str(str, empty_str);
+	// Appends several strings, growing 'str' at most once.
+	str_append_many(str, " One", " more", " time.");
+	// Same, with a separator between the strings.
+	str_join(str, ", ", " apples", "pears", "plums");
+	// Formats straight into 'str' like printf.
+	str_appendf(str, " %d%% done", 100);
+	// Appends numbers without parsing a format string.
+	str_append_int(str, -42);
+	str_append_uint(str, 42);
+	str_append_hex(str, 0xff);
+	str_append_double(str, 0.5);
+	// Returns a 64-bit hash of 'str'. It is cached until 'str' changes.
+	str_hash(str);
 	// Replaces all instances of 'new' to 'awesome'
 	str_replace(str, "new", "kickass");
 	// Returns a pointer to the data stored in str.
@@ -47,10 +78,40 @@ int main(void) {
 	str_cmp(str, "Hello, World! This is c-string! This is a kickass library!");
 	// Checks if 'str' has "c-string" in it. This function also returns a bool.
 	str_has(str, "c-string");
+	// Length aware versions of str_cmp and str_has.
+	str_equals_n(str, "Hello", 5);
+	str_has_n(str, "c-string", 8);
+	// Returns the offset of the first "is" in 'str' or STR_NPOS if there is none.
+	ulong pos = str_find(str, "is");
+	// Returns the offset of the next "is", starting the search at 'pos + 1'.
+	str_find_from(str, "is", pos + 1);
+	// Returns a view of 5 bytes of 'str' starting at offset 7. Nothing is
+	// copied. The view is valid until 'str' is modified.
+	str_view_t world = str_view(str, 7, 5);
+	// Views can be compared, searched for and appended with a single copy.
+	str_cmp_view(empty_str, world);
+	str_has_view(str, world);
+	str_append_view(empty_str, world);
+	// Splits 'str' on spaces without allocating. str_split_any() splits on
+	// a set of bytes and str_split_sep() on a multi-byte separator.
+	str_split_t split = str_split(str, ' ');
+	str_view_t word;
+	while (str_split_next(&split, &word)) {
+		// 'word' points into 'str'.
+	}
 	// Removes and returns last char of 'str'.
 	str_pop(str);
-	// Clears content of 'str'.
+	// Makes room for 1000 characters up front.
+	str_reserve(str, 1000);
+	// Gives back the capacity that the content doesn't need.
+	str_shrink_to_fit(str);
+	// Grows by 1.5x and never shrinks automatically.
+	str_policy_t policy = {.growth_percent = 150, .shrink = STR_SHRINK_NEVER};
+	str_set_policy(str, &policy);
+	// Clears content of 'str'. The capacity is kept for reuse.
 	str_clear(str);
+	// Clears content of 'str' and frees its memory.
+	str_release(str);
 
 	return 0;
 }
@@ -1,4 +1,5 @@
 #include <c-string.h>
+#include <string.h>
 
 // All functions are designed to return a status code (except str_destroy).
 // Getter and factory functions work through out parameters.
@@ -18,43 +19,108 @@ int main(void) {
 	// from the caller function in one line. This macro doesn't require gcc or clang.
 	
 	// Let's append some text at the end of 'str'
-	TRY(str->append(str, hello));
-	TRY(str->append(str, ", World! "));
-	TRY(str->append(str, this));
-	TRY(str->append(str, " is "));
-	TRY(str->append(str, c_string));
-	TRY(str->append(str, "!"));
+	TRY(str_append_fn(str, hello));
+	TRY(str_append_fn(str, ", World! "));
+	TRY(str_append_fn(str, this));
+	TRY(str_append_fn(str, " is "));
+	TRY(str_append_fn(str, c_string));
+	TRY(str_append_fn(str, "!"));
+
+	// Creates a copy of 'str' that shares its content until one of the
+	// two strings is modified
+	str_t *clone = NULL;
+	TRY(str_clone_fn(str, &clone));
+	str_destroy(&clone);
+
+	// Takes over a malloc()ed buffer without copying it
+	char *buf = malloc(64);
+	memcpy(buf, "raw bytes", 9);
+	str_t *owned = NULL;
+	TRY(create_str_from_owned(&owned, buf, 9, 64));
+	// Hands it back. 'owned' is left empty and 'buf' must be freed.
+	unsigned long buf_len = 0;
+	TRY(str_detach_fn(owned, &buf, &buf_len, NULL));
+	free(buf);
+	str_destroy(&owned);
 
 	// Further functions to operate over 'str'
 
 	// Appends 'src' at the end of 'str'.
-	TRY(str->append(str, " This is a new library"));
+	TRY(str_append_fn(str, " This is a new library"));
+	// Appends the first 5 bytes of 'src'. The bytes may include '\0'.
+	TRY(str_append_n_fn(str, " and then some", 5));
+	// Appends several strings, growing 'str' at most once.
+	const char *parts[] = {" One", " more", " time."};
+	TRY(str_append_many_fn(str, parts, 3));
+	// Same, with a separator between the strings.
+	TRY(str_join_fn(str, ", ", parts, 3));
+	// Formats straight into 'str' like printf
+	TRY(str_appendf_fn(str, " %d%% done", 100));
+	// Appends numbers without parsing a format string
+	TRY(str_append_int_fn(str, -42));
+	TRY(str_append_uint_fn(str, 42));
+	TRY(str_append_hex_fn(str, 0xff));
+	TRY(str_append_double_fn(str, 0.5));
+	// Hashes 'str'. The hash is cached until 'str' changes.
+	unsigned long hash = 0;
+	TRY(str_hash_fn(str, &hash));
 	// Replaces all instances of 'new' to 'awesome'
-	TRY(str->replace(str, "new", "kickass"));
+	TRY(str_replace_fn(str, "new", "kickass"));
 	// Returns a pointer to the data stored in str.
 	// This is reference and not a copy!
 	// This is the only 'unsafe' feature of the library. Tinking of a better solution.
 	const char *data = NULL;
-	TRY(str->data(str, &data));
+	TRY(str_data_fn(str, &data));
 	// Returns the length of 'str'
 	unsigned long len = 0;
-	TRY(str->len(str, &len));
+	TRY(str_len_fn(str, &len));
 	// Returns the capacity of 'str'
 	unsigned long capacity = 0;
-	TRY(str->capacity(str, &capacity));
+	TRY(str_capacity_fn(str, &capacity));
 	// Appends '!' at the end of 'str'
-	TRY(str->push(str, '!'));
+	TRY(str_push_fn(str, '!'));
 	// Compares contents of 'str' with the second argument
 	bool is_same = false;
-	TRY(str->cmp(str, "Hello, World! This is c-string! This is a kickass library!", &is_same));
+	TRY(str_cmp_fn(str, "Hello, World! This is c-string! This is a kickass library!", &is_same));
 	// Checks if 'str' has "c-string" in it
 	bool has_c_string = false;
-	TRY(str->has(str, "c-string", &has_c_string));
+	TRY(str_has_fn(str, "c-string", &has_c_string));
+	// Length aware versions of cmp and has
+	TRY(str_equals_n_fn(str, "Hello", 5, &is_same));
+	TRY(str_has_n_fn(str, "c-string", 8, &has_c_string));
+	// Finds the offset of the first "is" in 'str' (STR_NPOS if there is none)
+	unsigned long pos = 0;
+	TRY(str_find_fn(str, "is", &pos));
+	// Finds the next "is", starting the search at 'pos + 1'
+	TRY(str_find_from_fn(str, "is", pos + 1, &pos));
+	// Takes a view of 5 bytes of 'str' starting at offset 7 without copying.
+	// The view is valid until 'str' is modified.
+	str_view_t world;
+	TRY(str_view_fn(str, 7, 5, &world));
+	// Views can be compared, searched for and appended with a single copy.
+	TRY(str_cmp_view_fn(str, world, &is_same));
+	TRY(str_has_view_fn(str, world, &has_c_string));
+	// Splits 'str' on spaces without allocating. str_split_any_fn() splits
+	// on a set of bytes and str_split_sep_fn() on a multi-byte separator.
+	str_split_t split;
+	TRY(str_split_fn(str, ' ', &split));
+	str_view_t words[16];
+	unsigned long num_words = 0;
+	TRY(str_split_into_fn(&split, words, 16, &num_words));
 	// Removes and returns last char of 'str'
 	char last_char;
-	TRY(str->pop(str, &last_char));
-	// Clears content of 'str'.
-	TRY(str->clear(str));
+	TRY(str_pop_fn(str, &last_char));
+	// Makes room for 1000 characters up front
+	TRY(str_reserve_fn(str, 1000));
+	// Gives back the capacity that the content doesn't need
+	TRY(str_shrink_to_fit_fn(str));
+	// Grows by 1.5x and never shrinks automatically
+	str_policy_t policy = {.growth_percent = 150, .shrink = STR_SHRINK_NEVER};
+	TRY(str_set_policy_fn(str, &policy));
+	// Clears content of 'str'. The capacity is kept for reuse.
+	TRY(str_clear_fn(str));
+	// Clears content of 'str' and frees its memory.
+	TRY(str_release_fn(str));
 	
 	// note: 'str' needs to be freed explicitly with the following function:
 	str_destroy(&str);
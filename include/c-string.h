@@ -31,6 +31,7 @@ SOFTWARE.
 #include <sys/types.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <stdarg.h>
 
 /* Status codes */
 typedef enum str_status {
@@ -39,25 +40,187 @@ typedef enum str_status {
 	STR_REALLOC_ERROR,
 	STR_NOT_EMPTY,
 	STR_EMPTY,
-	STR_NULL_PTR
+	STR_NULL_PTR,
+	STR_INVALID_ARG,
+	STR_OUT_OF_RANGE,
+	STR_IMMUTABLE,
+	STR_IO_ERROR
 } str_status_t;
 
-/* String object struct forward declaration */
+/* Decides when a string gives memory back as its content shrinks.
+ * shrink_to_fit() can be used to release memory explicitly. */
+typedef enum str_shrink {
+	/* Capacity never shrinks automatically. */
+	STR_SHRINK_NEVER,
+	/* Capacity is halved once the content uses a quarter of it or less.
+	 * Content oscillating around a boundary does not cause reallocations. */
+	STR_SHRINK_HYSTERESIS,
+	/* Capacity is halved as soon as the content uses less than half of it. */
+	STR_SHRINK_EAGER
+} str_shrink_t;
+
+/* Growth and shrink policy of a string. */
+typedef struct str_policy {
+	/* Capacity is multiplied by growth_percent / 100 when the content
+	 * no longer fits. Must be greater than 100. */
+	uint growth_percent;
+	str_shrink_t shrink;
+} str_policy_t;
+
+/* Position returned by the find functions when there is no match. */
+#define STR_NPOS ((ulong)-1)
+
+/* Non-owning reference to 'len' bytes starting at 'data'.
+ * A view taken from a string is not null terminated and is only valid
+ * until the string is modified or destroyed. */
+typedef struct str_view {
+	const char *data;
+	ulong len;
+} str_view_t;
+
+/* Match reported by str_find_all(): 'len' bytes at 'pos' equal to
+ * pattern number 'pattern' of the matcher. */
+typedef struct str_match {
+	ulong pos;
+	ulong len;
+	ulong pattern;
+} str_match_t;
+
+/* Splitting mode of a str_split_t. */
+typedef enum str_split_mode {
+	STR_SPLIT_BYTE,
+	STR_SPLIT_BYTE_SET,
+	STR_SPLIT_SEPARATOR
+} str_split_mode_t;
+
+/* Iterator over the tokens of a string, set up by one of the split
+ * functions. It lives wherever the caller puts it and never allocates.
+ * The fields are private. The string must not be modified while it is
+ * being split. */
+typedef struct str_split {
+	const char *data;
+	ulong len;
+	ulong pos;
+	bool done;
+	str_split_mode_t mode;
+	char delim;
+	const char *sep;
+	ulong sep_len;
+	/* One bit per byte value for STR_SPLIT_BYTE_SET. */
+	unsigned char set[32];
+} str_split_t;
+
+/* Memory allocator used by a string object.
+ * All functions receive 'ctx' as their first argument.
+ * The sizes passed to realloc and free are the ones the block was
+ * allocated or last resized with, so simple allocators don't need to
+ * track them. */
+typedef struct str_allocator {
+	/* Returns a block of 'size' bytes or NULL on failure. */
+	void *(*alloc)(void *ctx, size_t size);
+	/* Resizes 'ptr' to 'new_size' bytes, preserving its content like
+	 * realloc(). Returns NULL on failure, leaving 'ptr' untouched. */
+	void *(*realloc)(void *ctx, void *ptr, size_t old_size, size_t new_size);
+	/* Frees 'ptr'. */
+	void (*free)(void *ctx, void *ptr, size_t size);
+	void *ctx;
+} str_allocator_t;
+
+/* Bump allocator that hands out memory from large chunks.
+ * Everything allocated from it is freed at once with str_arena_reset()
+ * or str_arena_destroy(). */
+typedef struct str_arena str_arena_t;
+
+/* Opaque string object. Its content is only accessible through the
+ * functions and macros below. */
 typedef struct str str_t;
 
-/* This opaque struct is used to encapsulate the data contained
- * in the string object while allowing exposureof the function pointers. */
-typedef struct str_priv str_priv_t;
+/* Table that maps contents to a single immutable string instance, so
+ * interned strings with the same content are the same pointer.
+ * Any number of threads can intern into the same table concurrently.
+ * Lookups of existing strings don't lock and inserts only lock one of
+ * the table's shards. Interned strings can be read from any thread. */
+typedef struct str_intern str_intern_t;
+
+/* Needle prepared once for repeated searches: its length is cached and
+ * long needles get a Horspool shift table. A pattern is never modified
+ * after it is created, so any number of threads can use it at once. */
+typedef struct str_pattern str_pattern_t;
+
+/* Set of patterns compiled into an automaton that finds all of them in
+ * one pass over a string, at a cost per byte that doesn't depend on the
+ * number of patterns. Scanning is read-only, so a matcher can be shared
+ * between threads. */
+typedef struct str_matcher str_matcher_t;
+
+/* Large string stored as a balanced tree of chunks. Concatenation,
+ * insertion, erasure and substrings take O(log n) time and don't copy
+ * the content. Ropes share chunks with each other, so cloning one is O(1).
+ * A rope can be used from one thread at a time, but ropes that share
+ * chunks may be used from different threads. */
+typedef struct str_rope str_rope_t;
+
+/* Iterator over the chunks of a rope, set up by str_rope_iter_fn().
+ * The rope must not be modified or destroyed while it is in use. */
+typedef struct str_rope_iter {
+	/* Private. Subtrees still to be visited. */
+	const struct str_rope_node *stack[96];
+	uint depth;
+} str_rope_iter_t;
+
+/* Reads lines from a file descriptor through a buffer of its own.
+ * Lines are handed out as views into the buffer, so the steady state
+ * allocates nothing and copies every byte once, from the kernel. */
+typedef struct str_reader str_reader_t;
+
+#ifdef C_STRING_STATS
+/* Counters kept by builds configured with C_STRING_STATS.
+ * Every thread has its own set, covering the strings it operated on. */
+typedef struct str_stats {
+	/* Calls made to the allocator, string objects included. */
+	ulong allocs;
+	ulong reallocs;
+	ulong frees;
+	/* Sum of the sizes passed to alloc and realloc. */
+	ulong bytes_allocated;
+	/* Bytes moved by the library itself, excluding copies done
+	 * inside realloc. */
+	ulong bytes_copied;
+	/* Capacity changes made by the growth and shrink policy,
+	 * reserve() and shrink_to_fit(). */
+	ulong grows;
+	ulong shrinks;
+	/* Largest capacity any string reached. */
+	ulong peak_capacity;
+	/* Number of calls per operation. Variants share a counter,
+	 * e.g. append_n() and append_str() count as append. */
+	struct {
+		ulong create;
+		ulong clone;
+		ulong destroy;
+		ulong append;
+		ulong replace;
+		ulong push;
+		ulong pop;
+		ulong clear;
+		ulong release;
+		ulong search;
+		ulong compare;
+		ulong reserve;
+		ulong shrink_to_fit;
+	} calls;
+} str_stats_t;
+#endif
 
 /* Macro warppers. 
  * NOTE: gcc / clang only!
  *
  * These macros can only be used with clang or gcc.
- * The basic function pointers found further down are pure C and
+ * The basic functions found further down are pure C and
  * therefore are much more portable.
  * However, if your development environment allows gcc and clang extensions,
  * I recommend that you use these macros instead of the pure 
- * function pointers directly for increased type and memory safety
+ * functions directly for increased type and memory safety
  * and consistency.
  * All of these macros implicitly check the resulting str_status_t
  * and exit early from the caller function upon failure. On success,
@@ -93,6 +256,18 @@ typedef struct str_priv str_priv_t;
 	/* This can only be used with clang or gcc. */
 #endif
 
+#ifdef __GNUC__
+#define PRINTF_LIKE(fmt_index, args_index)\
+	\
+	/* Lets the compiler check the arguments against the format string. */\
+	\
+	__attribute__((format(printf, fmt_index, args_index)))
+#else
+#define PRINTF_LIKE(fmt_index, args_index)\
+	\
+	/* This can only be used with clang or gcc. */
+#endif
+
 #define str_auto\
 	\
 	/* Used when initialising the str_t* object.
@@ -113,13 +288,51 @@ typedef struct str_priv str_priv_t;
 	 	str_t *str = NULL;\
 		TRY(create_str(&str));\
 	 	const char *args[] = {__VA_ARGS__};\
-		uint num_args = sizeof(args) / sizeof(char*);\
-		for (uint i = 0; i < num_args; i++) {\
-			str_append(str, args[i]);\
-		}\
+		TRY(str_append_many_fn(str, args, sizeof(args) / sizeof(char*)));\
+		str;\
+	 })
+
+#define str_clone(str)\
+	\
+	/* Returns a new instance of str_t with the content of 'str'.
+	 * Long content is shared rather than copied until either string
+	 * is modified.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	({\
+	 	if (!str) return STR_NULL_PTR;\
+	 	str_t *clone = NULL;\
+		TRY(str_clone_fn(str, &clone));\
+		clone;\
+	 })
+
+#define str_from_owned(buf, len, capacity)\
+	\
+	/* Returns a new instance of str_t that takes over the malloc()ed
+	 * buffer 'buf' of 'capacity' bytes holding 'len' bytes of content.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	({\
+	 	str_t *str = NULL;\
+		TRY(create_str_from_owned(&str, buf, len, capacity));\
 		str;\
 	 })
 
+#define str_detach(str, len, capacity)\
+	\
+	/* Takes the buffer out of 'str' and returns it. The caller owns it
+	 * from then on. Its length and capacity are stored through the
+	 * ulong pointers 'len' and 'capacity', either of which may be NULL.
+	 * 'str' is left empty.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	({\
+	 	if (!str) return STR_NULL_PTR;\
+		char *buf = NULL;\
+		TRY(str_detach_fn(str, &buf, len, capacity));\
+		buf;\
+	 })
+
 #define str_append(str, src)\
 	\
 	/* Appends 'src' at the end of 'str'.
@@ -127,7 +340,84 @@ typedef struct str_priv str_priv_t;
 	\
 	do {\
 		if (!str) return STR_NULL_PTR;\
-		TRY(str->append(str, src));\
+		TRY(str_append_fn(str, src));\
+	} while(0)
+
+#define str_append_many(str, ...)\
+	\
+	/* Appends every string passed after 'str' at the end of 'str',
+	 * growing it at most once.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	do {\
+		if (!str) return STR_NULL_PTR;\
+		const char *parts[] = {__VA_ARGS__};\
+		TRY(str_append_many_fn(str, parts, sizeof(parts) / sizeof(char*)));\
+	} while(0)
+
+#define str_join(str, sep, ...)\
+	\
+	/* Appends every string passed after 'sep' at the end of 'str' with
+	 * 'sep' between them, growing 'str' at most once.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	do {\
+		if (!str) return STR_NULL_PTR;\
+		const char *parts[] = {__VA_ARGS__};\
+		TRY(str_join_fn(str, sep, parts, sizeof(parts) / sizeof(char*)));\
+	} while(0)
+
+#define str_appendf(str, fmt, ...)\
+	\
+	/* Appends the output of printf-style formatting at the end of 'str'.
+	 * The arguments must not point into 'str'.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	do {\
+		if (!str) return STR_NULL_PTR;\
+		TRY(str_appendf_fn(str, fmt, ##__VA_ARGS__));\
+	} while(0)
+
+#define str_append_int(str, value)\
+	\
+	/* Appends the decimal representation of the long 'value' to 'str'.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	do {\
+		if (!str) return STR_NULL_PTR;\
+		TRY(str_append_int_fn(str, value));\
+	} while(0)
+
+#define str_append_uint(str, value)\
+	\
+	/* Appends the decimal representation of the ulong 'value' to 'str'.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	do {\
+		if (!str) return STR_NULL_PTR;\
+		TRY(str_append_uint_fn(str, value));\
+	} while(0)
+
+#define str_append_hex(str, value)\
+	\
+	/* Appends the lowercase hexadecimal representation of the ulong
+	 * 'value' to 'str', without prefix or padding.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	do {\
+		if (!str) return STR_NULL_PTR;\
+		TRY(str_append_hex_fn(str, value));\
+	} while(0)
+
+#define str_append_double(str, value)\
+	\
+	/* Appends 'value' with the fewest of 15 to 17 significant digits that
+	 * read back as the same double.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	do {\
+		if (!str) return STR_NULL_PTR;\
+		TRY(str_append_double_fn(str, value));\
 	} while(0)
 
 #define str_replace(str, old_str, new_str)\
@@ -137,7 +427,79 @@ typedef struct str_priv str_priv_t;
 	\
 	do {\
 		if (!str) return STR_NULL_PTR;\
-		TRY(str->replace(str, old_str, new_str));\
+		TRY(str_replace_fn(str, old_str, new_str));\
+	} while (0)
+
+#define str_has_pattern(str, pattern)\
+	\
+	/* Returns true if 'str' contains the needle of 'pattern'.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	({\
+		if (!str) return STR_NULL_PTR;\
+		bool has;\
+		TRY(str_has_pattern_fn(str, pattern, &has));\
+		has;\
+	})
+
+#define str_count_pattern(str, pattern)\
+	\
+	/* Returns the number of non-overlapping occurrences of the needle of
+	 * 'pattern' in 'str'.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	({\
+		if (!str) return STR_NULL_PTR;\
+		ulong count;\
+		TRY(str_count_pattern_fn(str, pattern, &count));\
+		count;\
+	})
+
+#define str_replace_pattern(str, pattern, new_str)\
+	\
+	/* Replaces all instances of the needle of 'pattern' with 'new_str'
+	 * in 'str'.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	do {\
+		if (!str) return STR_NULL_PTR;\
+		TRY(str_replace_pattern_fn(str, pattern, new_str));\
+	} while (0)
+
+#define str_has_any(str, matcher)\
+	\
+	/* Returns true if 'str' contains any of the patterns of 'matcher'.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	({\
+		if (!str) return STR_NULL_PTR;\
+		bool has;\
+		TRY(str_has_any_fn(str, matcher, &has));\
+		has;\
+	})
+
+#define str_find_all(str, matcher, matches, max_matches)\
+	\
+	/* Stores up to 'max_matches' of the matches of 'matcher' in 'str' in
+	 * the array 'matches' and returns the total number of matches.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	({\
+		if (!str) return STR_NULL_PTR;\
+		ulong num_matches;\
+		TRY(str_find_all_fn(str, matcher, matches, max_matches, &num_matches));\
+		num_matches;\
+	})
+
+#define str_replace_all_map(str, matcher, replacements)\
+	\
+	/* Replaces every match of 'matcher' in 'str' with the string at the
+	 * same index in 'replacements' as the pattern that matched.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	do {\
+		if (!str) return STR_NULL_PTR;\
+		TRY(str_replace_all_map_fn(str, matcher, replacements));\
 	} while (0)
 
 #define str_data(str)\
@@ -151,7 +513,7 @@ typedef struct str_priv str_priv_t;
 	({\
 	 	if (!str) return STR_NULL_PTR;\
 		const char *dest = NULL;\
-		TRY(str->data(str, &dest));\
+		TRY(str_data_fn(str, &dest));\
 		dest;\
 	 })
 
@@ -163,7 +525,7 @@ typedef struct str_priv str_priv_t;
 	({\
 	 	if (!str) return STR_NULL_PTR;\
 		ulong len = 0;\
-		TRY(str->len(str, &len));\
+		TRY(str_len_fn(str, &len));\
 		len;\
 	 })
 
@@ -175,7 +537,7 @@ typedef struct str_priv str_priv_t;
 	({\
 	 	if (!str) return STR_NULL_PTR;\
 		ulong capacity = 0;\
-		TRY(str->capacity(str, &capacity));\
+		TRY(str_capacity_fn(str, &capacity));\
 		capacity;\
 	 })
 
@@ -186,7 +548,7 @@ typedef struct str_priv str_priv_t;
 	\
 	 do {\
 	 	if (!str) return STR_NULL_PTR;\
-		TRY(str->push(str, c));\
+		TRY(str_push_fn(str, c));\
 	 } while(0)
 
 #define str_pop(str)\
@@ -197,18 +559,30 @@ typedef struct str_priv str_priv_t;
 	({\
 	 	if (!str) return STR_NULL_PTR;\
 		char c;\
-		TRY(str->pop(str, &c));\
+		TRY(str_pop_fn(str, &c));\
 		c;\
 	 })
 
 #define str_clear(str)\
 	\
-	/* Clears content of 'str'.
+	/* Clears content of 'str'. The capacity is kept, so 'str' can be
+	 * refilled without reallocating. Use str_release to free the memory.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	 do {\
+	 	if (!str) return STR_NULL_PTR;\
+		TRY(str_clear_fn(str));\
+	 } while (0)
+
+#define str_release(str)\
+	\
+	/* Clears content of 'str' and frees its memory, resetting the capacity
+	 * to the default.
 	 * Returns early from the caller with a status code on failure.*/\
 	\
 	 do {\
 	 	if (!str) return STR_NULL_PTR;\
-		TRY(str->clear(str));\
+		TRY(str_release_fn(str));\
 	 } while (0)
 
 #define str_cmp(str, pattern)\
@@ -220,7 +594,7 @@ typedef struct str_priv str_priv_t;
 	({\
 	 	if (!str) return STR_NULL_PTR;\
 		bool is_same;\
-		TRY(str->cmp(str, pattern, &is_same));\
+		TRY(str_cmp_fn(str, pattern, &is_same));\
 		is_same;\
 	})
 
@@ -233,70 +607,918 @@ typedef struct str_priv str_priv_t;
 	({\
 	 	if (!str) return STR_NULL_PTR;\
 		bool has;\
-		TRY(str->has(str, pattern, &has));\
+		TRY(str_has_fn(str, pattern, &has));\
 		has;\
 	})
 
-/* Function pointers. 
- * Only to be used if the development environment doesn't allow gcc or 
- * clang extensions or if direct control of required. */
+#define str_find(str, pattern)\
+	\
+	/* Returns the offset of the first occurrence of 'pattern' in 'str'
+	 * or STR_NPOS if there is none.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	({\
+	 	if (!str) return STR_NULL_PTR;\
+		ulong match_pos;\
+		TRY(str_find_fn(str, pattern, &match_pos));\
+		match_pos;\
+	})
+
+#define str_find_from(str, pattern, from)\
+	\
+	/* Returns the offset of the first occurrence of 'pattern' in 'str'
+	 * that starts at or after 'from', or STR_NPOS if there is none.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	({\
+	 	if (!str) return STR_NULL_PTR;\
+		ulong match_pos;\
+		TRY(str_find_from_fn(str, pattern, from, &match_pos));\
+		match_pos;\
+	})
 
-struct str {
-	str_priv_t *priv;
+#define str_append_n(str, src, src_len)\
+	\
+	/* Appends the first 'src_len' bytes of 'src' at the end of 'str'.
+	 * 'src' may contain null bytes.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	do {\
+		if (!str) return STR_NULL_PTR;\
+		TRY(str_append_n_fn(str, src, src_len));\
+	} while(0)
 
-	/* Appends 'src' at the end of str */
-	MUST_USE_RESULT
-	str_status_t (*append)(str_t *self, const char *src);
+#define str_append_str(str, src)\
+	\
+	/* Appends the content of the string object 'src' at the end of 'str'.
+	 * 'src' may be 'str' itself.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	do {\
+		if (!str) return STR_NULL_PTR;\
+		TRY(str_append_str_fn(str, src));\
+	} while(0)
 
-	/* Replaces all occurrences of 'old_str' with 'new_str' in str */
-	MUST_USE_RESULT
-	str_status_t (*replace)(str_t *self, const char *old_str, const char *new_str);
+#define str_equals_n(str, pattern, pattern_len)\
+	\
+	/* Compares contents of 'str' and the first 'pattern_len' bytes of
+	 * 'pattern'. Returns a boolean indicating whether they are identical.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	({\
+	 	if (!str) return STR_NULL_PTR;\
+		bool is_same;\
+		TRY(str_equals_n_fn(str, pattern, pattern_len, &is_same));\
+		is_same;\
+	})
 
-	/* Copies a pointer to the content of str into dest.
-	 * This is a reference and not a copy of the content!
-	 * Changes made to the original content will be reflected through this reference. */
-	MUST_USE_RESULT
-	str_status_t (*data)(const str_t *self, const char **dest);
+#define str_has_n(str, pattern, pattern_len)\
+	\
+	/* Checks if the first 'pattern_len' bytes of 'pattern' are present in
+	 * 'str' and returns a boolean that indicates the result.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	({\
+	 	if (!str) return STR_NULL_PTR;\
+		bool has;\
+		TRY(str_has_n_fn(str, pattern, pattern_len, &has));\
+		has;\
+	})
 
-	/* Returns the length of str. */
-	MUST_USE_RESULT
-	str_status_t (*len)(const str_t *self, ulong *len);
+#define str_reserve(str, len)\
+	\
+	/* Makes sure 'str' can hold 'len' characters without reallocating.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	do {\
+		if (!str) return STR_NULL_PTR;\
+		TRY(str_reserve_fn(str, len));\
+	} while(0)
 
-	/* Returns the capacity of str. */
-	MUST_USE_RESULT
-	str_status_t (*capacity)(const str_t *self, ulong *capacity);
+#define str_shrink_to_fit(str)\
+	\
+	/* Reduces the capacity of 'str' to what its content needs.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	do {\
+		if (!str) return STR_NULL_PTR;\
+		TRY(str_shrink_to_fit_fn(str));\
+	} while(0)
 
-	/* Appends 'c' at the end of str. */
-	MUST_USE_RESULT
-	str_status_t (*push)(str_t *self, char c);
+#define str_set_policy(str, policy)\
+	\
+	/* Sets the growth and shrink policy of 'str'.
+	 * 'policy' is a pointer to str_policy_t.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	do {\
+		if (!str) return STR_NULL_PTR;\
+		TRY(str_set_policy_fn(str, policy));\
+	} while(0)
 
-	/* Removes and returns the last character of str. */
-	MUST_USE_RESULT
-	str_status_t (*pop)(str_t *self, char *c);
+#define str_view(str, pos, len)\
+	\
+	/* Returns a str_view_t of at most 'len' bytes of 'str' starting at
+	 * 'pos'. STR_NPOS as 'len' selects everything up to the end.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	({\
+	 	if (!str) return STR_NULL_PTR;\
+		str_view_t view;\
+		TRY(str_view_fn(str, pos, len, &view));\
+		view;\
+	})
 
-	/* Clears content of str */
-	MUST_USE_RESULT
-	str_status_t (*clear)(str_t *self);
+#define str_append_view(str, view)\
+	\
+	/* Appends the bytes referenced by 'view' at the end of 'str'.
+	 * 'view' may point into 'str' itself.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	do {\
+		if (!str) return STR_NULL_PTR;\
+		TRY(str_append_view_fn(str, view));\
+	} while(0)
 
-	/* Compares str with 'pattern' and sets 'is_same' to true if they are the same. */
-	MUST_USE_RESULT
-	str_status_t (*cmp)(const str_t *self, const char *pattern, bool *is_same);
+#define str_cmp_view(str, view)\
+	\
+	/* Compares contents of 'str' and 'view'.
+	 * Returns a boolean indicating whether they are identical.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	({\
+	 	if (!str) return STR_NULL_PTR;\
+		bool is_same;\
+		TRY(str_cmp_view_fn(str, view, &is_same));\
+		is_same;\
+	})
 
-	/* Checks if str has 'pattern' in it and sets 'has' to true of so. */
-	MUST_USE_RESULT
-	str_status_t (*has)(const str_t *self, const char *pattern, bool *has);
-};
+#define str_has_view(str, view)\
+	\
+	/* Checks if the bytes referenced by 'view' are present in 'str' and
+	 * returns a boolean that indicates the result.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	({\
+	 	if (!str) return STR_NULL_PTR;\
+		bool has;\
+		TRY(str_has_view_fn(str, view, &has));\
+		has;\
+	})
 
-/* Creates new instance of str_t.
- * 'str' must be NULL! */
-MUST_USE_RESULT
-str_status_t create_str(str_t **str);
+#define str_split(str, delim)\
+	\
+	/* Returns a str_split_t that yields the parts of 'str' between
+	 * occurrences of the byte 'delim'.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	({\
+	 	if (!str) return STR_NULL_PTR;\
+		str_split_t split;\
+		TRY(str_split_fn(str, delim, &split));\
+		split;\
+	})
 
-/* Frees all memory allocated in 'str' */
-void str_destroy(str_t **str);
+#define str_split_any(str, delims)\
+	\
+	/* Returns a str_split_t that splits 'str' on any of the bytes in the
+	 * null terminated string 'delims'.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	({\
+	 	if (!str) return STR_NULL_PTR;\
+		str_split_t split;\
+		TRY(str_split_any_fn(str, delims, &split));\
+		split;\
+	})
 
-/* This var is important for testing str_destroy() */
-extern bool _is_str_destroyed;
+#define str_split_sep(str, sep)\
+	\
+	/* Returns a str_split_t that splits 'str' on occurrences of the
+	 * string 'sep'.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	({\
+	 	if (!str) return STR_NULL_PTR;\
+		str_split_t split;\
+		TRY(str_split_sep_fn(str, sep, &split));\
+		split;\
+	})
+
+#define str_split_next(split, token)\
+	\
+	/* Sets the str_view_t pointed to by 'token' to the next token of the
+	 * str_split_t pointed to by 'split'. Returns false when there are no
+	 * more tokens.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	({\
+		bool has_token;\
+		TRY(str_split_next_fn(split, token, &has_token));\
+		has_token;\
+	})
+
+#define str_split_into(split, tokens, max_tokens)\
+	\
+	/* Stores up to 'max_tokens' of the next tokens of 'split' in the
+	 * array 'tokens' and returns how many were stored.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	({\
+		ulong num_tokens;\
+		TRY(str_split_into_fn(split, tokens, max_tokens, &num_tokens));\
+		num_tokens;\
+	})
+
+#define str_hash(str)\
+	\
+	/* Returns a 64-bit hash of the content of 'str'. The hash is cached
+	 * until 'str' is modified.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	({\
+	 	if (!str) return STR_NULL_PTR;\
+		ulong hash;\
+		TRY(str_hash_fn(str, &hash));\
+		hash;\
+	})
+
+#define str_freeze(str)\
+	\
+	/* Makes 'str' immutable. Operations that would change its content
+	 * fail with STR_IMMUTABLE from then on.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	do {\
+		if (!str) return STR_NULL_PTR;\
+		TRY(str_freeze_fn(str));\
+	} while(0)
+
+#define str_intern(intern, src)\
+	\
+	/* Returns the canonical immutable string with the same content as
+	 * the null terminated 'src', adding it to 'intern' if needed.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	({\
+	 	if (!intern) return STR_NULL_PTR;\
+		const str_t *interned = NULL;\
+		TRY(str_intern_fn(intern, src, &interned));\
+		interned;\
+	})
+
+#define str_reader_next(reader, line)\
+	\
+	/* Sets the str_view_t pointed to by 'line' to the next line read by
+	 * 'reader'. Returns false when the input has ended.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	({\
+		bool has_line;\
+		TRY(str_reader_next_fn(reader, line, &has_line));\
+		has_line;\
+	})
+
+#define str_reader_next_into(reader, str)\
+	\
+	/* Replaces the content of 'str' with the next line read by 'reader'.
+	 * Returns false when the input has ended.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	({\
+		bool has_line;\
+		TRY(str_reader_next_into_fn(reader, str, &has_line));\
+		has_line;\
+	})
+
+#define str_rope_append(rope, src)\
+	\
+	/* Appends the null terminated 'src' to 'rope'.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	do {\
+		if (!rope) return STR_NULL_PTR;\
+		TRY(str_rope_append_fn(rope, src));\
+	} while(0)
+
+#define str_rope_insert(rope, pos, src)\
+	\
+	/* Inserts the null terminated 'src' into 'rope' at 'pos'.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	do {\
+		if (!rope) return STR_NULL_PTR;\
+		TRY(str_rope_insert_str_fn(rope, pos, src));\
+	} while(0)
+
+#define str_rope_erase(rope, pos, len)\
+	\
+	/* Removes 'len' bytes starting at 'pos' from 'rope'.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	do {\
+		if (!rope) return STR_NULL_PTR;\
+		TRY(str_rope_erase_fn(rope, pos, len));\
+	} while(0)
+
+#define str_rope_len(rope)\
+	\
+	/* Returns the number of bytes in 'rope'.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	({\
+		if (!rope) return STR_NULL_PTR;\
+		ulong len;\
+		TRY(str_rope_len_fn(rope, &len));\
+		len;\
+	})
+
+#define str_rope_next_chunk(iter, chunk)\
+	\
+	/* Sets the str_view_t pointed to by 'chunk' to the next chunk of the
+	 * str_rope_iter_t pointed to by 'iter'. Returns false when there are
+	 * no more chunks.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	({\
+		bool has_chunk;\
+		TRY(str_rope_iter_next_fn(iter, chunk, &has_chunk));\
+		has_chunk;\
+	})
+
+#define str_read_file(str, path)\
+	\
+	/* Appends the content of the file at 'path' to 'str'.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	do {\
+		if (!str) return STR_NULL_PTR;\
+		TRY(str_read_file_fn(str, path));\
+	} while(0)
+
+#define str_read_fd(str, fd)\
+	\
+	/* Appends everything that can be read from 'fd' to 'str'.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	do {\
+		if (!str) return STR_NULL_PTR;\
+		TRY(str_read_fd_fn(str, fd));\
+	} while(0)
+
+#define str_write_fd(str, fd)\
+	\
+	/* Writes the content of 'str' to 'fd'.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	do {\
+		if (!str) return STR_NULL_PTR;\
+		TRY(str_write_fd_fn(str, fd));\
+	} while(0)
+
+#define str_writev_fd(fd, ...)\
+	\
+	/* Writes the contents of the strings passed after 'fd' to 'fd' in
+	 * order, with a single writev() call if possible.
+	 * Returns early from the caller with a status code on failure.*/\
+	\
+	do {\
+		const str_t *strs[] = {__VA_ARGS__};\
+		TRY(str_writev_fd_fn(fd, strs, sizeof(strs) / sizeof(str_t*)));\
+	} while(0)
+
+/* Functions.
+ * Only to be used if the development environment doesn't allow gcc or 
+ * clang extensions or if direct control of required. */
+
+/* Appends 'src' at the end of str */
+MUST_USE_RESULT
+str_status_t str_append_fn(str_t *self, const char *src);
+
+/* Appends the 'num_parts' strings in 'parts' at the end of str.
+ * The total length is computed up front so str grows at most once. */
+MUST_USE_RESULT
+str_status_t str_append_many_fn(str_t *self, const char **parts, ulong num_parts);
+
+/* Same as append_many() but takes the length of each part from 'lens',
+ * so the parts may contain null bytes. */
+MUST_USE_RESULT
+str_status_t str_append_many_n_fn(
+	str_t *self, const char **parts, const ulong *lens, ulong num_parts
+);
+
+/* Same as append_many() but puts 'sep' between the parts. */
+MUST_USE_RESULT
+str_status_t str_join_fn(str_t *self, const char *sep, const char **parts, ulong num_parts);
+
+/* Appends the output of printf-style formatting at the end of str.
+ * The output is written straight into the spare capacity. If it does not
+ * fit, str grows once to the exact size and the formatting is repeated.
+ * The arguments must not point into str.
+ * Returns STR_INVALID_ARG if formatting fails. */
+MUST_USE_RESULT
+PRINTF_LIKE(2, 3)
+str_status_t str_appendf_fn(str_t *self, const char *fmt, ...);
+
+/* Same as appendf() but takes the arguments as a va_list. */
+MUST_USE_RESULT
+PRINTF_LIKE(2, 0)
+str_status_t str_vappendf_fn(str_t *self, const char *fmt, va_list args);
+
+/* Appends the decimal representation of 'value' at the end of str. */
+MUST_USE_RESULT
+str_status_t str_append_int_fn(str_t *self, long value);
+
+/* Appends the decimal representation of 'value' at the end of str. */
+MUST_USE_RESULT
+str_status_t str_append_uint_fn(str_t *self, ulong value);
+
+/* Appends the lowercase hexadecimal representation of 'value' at the end
+ * of str, without prefix or padding. */
+MUST_USE_RESULT
+str_status_t str_append_hex_fn(str_t *self, ulong value);
+
+/* Appends 'value' with the fewest of 15 to 17 significant digits that
+ * read back as the same double, e.g. "0.1" or "1e+300". This is not always
+ * the shortest form: 5e-324 comes out as "4.94065645841247e-324". Each
+ * value costs up to three snprintf() and strtod() calls. */
+MUST_USE_RESULT
+str_status_t str_append_double_fn(str_t *self, double value);
+
+/* Replaces all occurrences of 'old_str' with 'new_str' in str */
+MUST_USE_RESULT
+str_status_t str_replace_fn(str_t *self, const char *old_str, const char *new_str);
+
+/* Sets 'has' to true if str contains the needle of 'pattern'. */
+MUST_USE_RESULT
+str_status_t str_has_pattern_fn(const str_t *self, const str_pattern_t *pattern, bool *has);
+
+/* Sets 'count' to the number of non-overlapping occurrences of the needle
+ * of 'pattern' in str, counted from the left like str_replace_fn()
+ * replaces them. */
+MUST_USE_RESULT
+str_status_t str_count_pattern_fn(
+	const str_t *self, const str_pattern_t *pattern, ulong *count
+);
+
+/* Same as str_replace_fn() with the needle of 'pattern' as 'old_str'. */
+MUST_USE_RESULT
+str_status_t str_replace_pattern_fn(
+	str_t *self, const str_pattern_t *pattern, const char *new_str
+);
+
+/* Sets 'has' to true if str contains any of the patterns of 'matcher'. */
+MUST_USE_RESULT
+str_status_t str_has_any_fn(const str_t *self, const str_matcher_t *matcher, bool *has);
+
+/* Stores the first 'max_matches' matches of 'matcher' in str in 'matches'
+ * and sets 'num_matches' to the number of all matches, so a call with
+ * 'max_matches' 0 counts them.
+ * Matches are reported in the order in which they end. Of the patterns
+ * that end at the same byte the longest one is reported, and matches
+ * don't overlap: the search continues after the end of each match. E.g.
+ * with the patterns "bc" and "abcd", "abcd" yields "bc". */
+MUST_USE_RESULT
+str_status_t str_find_all_fn(
+	const str_t *self, const str_matcher_t *matcher,
+	str_match_t *matches, ulong max_matches, ulong *num_matches
+);
+
+/* Replaces every match of 'matcher' in str, as reported by
+ * str_find_all_fn(), with replacements[i], where i is the index of the
+ * pattern that matched. 'replacements' must hold a null terminated
+ * string for every pattern. The result is written in place and the
+ * buffer is grown at most once. */
+MUST_USE_RESULT
+str_status_t str_replace_all_map_fn(
+	str_t *self, const str_matcher_t *matcher, const char **replacements
+);
+
+/* str_data_fn(), str_len_fn() and str_capacity_fn() are function calls,
+ * since str_t is opaque. They are only inlined into callers built with link
+ * time optimization, which Release builds of this project enable. */
+
+/* Copies a pointer to the content of str into dest.
+ * This is a reference and not a copy of the content!
+ * Changes made to the original content will be reflected through this reference. */
+MUST_USE_RESULT
+str_status_t str_data_fn(const str_t *self, const char **dest);
+
+/* Returns the length of str. */
+MUST_USE_RESULT
+str_status_t str_len_fn(const str_t *self, ulong *len);
+
+/* Returns the capacity of str. */
+MUST_USE_RESULT
+str_status_t str_capacity_fn(const str_t *self, ulong *capacity);
+
+/* Appends 'c' at the end of str. */
+MUST_USE_RESULT
+str_status_t str_push_fn(str_t *self, char c);
+
+/* Removes and returns the last character of str. */
+MUST_USE_RESULT
+str_status_t str_pop_fn(str_t *self, char *c);
+
+/* Clears content of str. The capacity is kept. */
+MUST_USE_RESULT
+str_status_t str_clear_fn(str_t *self);
+
+/* Compares str with 'pattern' and sets 'is_same' to true if they are the same. */
+MUST_USE_RESULT
+str_status_t str_cmp_fn(const str_t *self, const char *pattern, bool *is_same);
+
+/* Checks if str has 'pattern' in it and sets 'has' to true of so. */
+MUST_USE_RESULT
+str_status_t str_has_fn(const str_t *self, const char *pattern, bool *has);
+
+/* Sets 'pos' to the offset of the first occurrence of 'pattern' in str
+ * or to STR_NPOS if there is none. */
+MUST_USE_RESULT
+str_status_t str_find_fn(const str_t *self, const char *pattern, ulong *pos);
+
+/* Same as find() but only considers occurrences that start at or after
+ * 'from'. */
+MUST_USE_RESULT
+str_status_t str_find_from_fn(
+	const str_t *self, const char *pattern, ulong from, ulong *pos
+);
+
+/* Appends the first 'src_len' bytes of 'src' at the end of str.
+ * 'src' may contain null bytes. */
+MUST_USE_RESULT
+str_status_t str_append_n_fn(str_t *self, const char *src, ulong src_len);
+
+/* Appends the content of 'src' at the end of str. */
+MUST_USE_RESULT
+str_status_t str_append_str_fn(str_t *self, const str_t *src);
+
+/* Compares str with the first 'pattern_len' bytes of 'pattern' and sets
+ * 'is_same' to true if they are the same. */
+MUST_USE_RESULT
+str_status_t str_equals_n_fn(
+	const str_t *self, const char *pattern, ulong pattern_len, bool *is_same
+);
+
+/* Checks if str has the first 'pattern_len' bytes of 'pattern' in it
+ * and sets 'has' to true if so. */
+MUST_USE_RESULT
+str_status_t str_has_n_fn(
+	const str_t *self, const char *pattern, ulong pattern_len, bool *has
+);
+
+/* Makes sure str can hold 'len' characters without reallocating.
+ * Returns STR_INVALID_ARG if 'len' leaves no room for the terminator. */
+MUST_USE_RESULT
+str_status_t str_reserve_fn(str_t *self, ulong len);
+
+/* Reduces the capacity of str to what its content needs. */
+MUST_USE_RESULT
+str_status_t str_shrink_to_fit_fn(str_t *self);
+
+/* Sets the growth and shrink policy of str. */
+MUST_USE_RESULT
+str_status_t str_set_policy_fn(str_t *self, const str_policy_t *policy);
+
+/* Clears content of str and frees its memory, resetting the capacity
+ * to the default. */
+MUST_USE_RESULT
+str_status_t str_release_fn(str_t *self);
+
+/* Sets 'view' to at most 'len' bytes of str starting at 'pos'.
+ * STR_NPOS as 'len' selects everything up to the end.
+ * Returns STR_OUT_OF_RANGE if 'pos' is past the end of str. */
+MUST_USE_RESULT
+str_status_t str_view_fn(const str_t *self, ulong pos, ulong len, str_view_t *view);
+
+/* Appends the bytes referenced by 'view' at the end of str. */
+MUST_USE_RESULT
+str_status_t str_append_view_fn(str_t *self, str_view_t view);
+
+/* Compares str with 'view' and sets 'is_same' to true if they are the same. */
+MUST_USE_RESULT
+str_status_t str_cmp_view_fn(const str_t *self, str_view_t view, bool *is_same);
+
+/* Checks if str has the bytes referenced by 'view' in it and sets 'has'
+ * to true if so. */
+MUST_USE_RESULT
+str_status_t str_has_view_fn(const str_t *self, str_view_t view, bool *has);
+
+/* Hands the null terminated buffer of str over to the caller through
+ * 'buf', along with its length and capacity if 'len' and 'capacity' are
+ * not NULL. The buffer comes from the allocator of str, so for strings made
+ * with create_str() or create_str_from_owned() it is freed with free().
+ * Heap content is handed over without copying. Content in the inline
+ * buffer is copied to a new allocation first. str is left empty. */
+MUST_USE_RESULT
+str_status_t str_detach_fn(str_t *self, char **buf, ulong *len, ulong *capacity);
+
+/* Appends everything that can be read from 'fd' until end of file to str.
+ * For regular files the buffer is sized once from fstat(). Other
+ * descriptors are read in chunks of at least 4 KB straight into the spare
+ * capacity. Interrupted reads are retried. If reading fails,
+ * STR_IO_ERROR is returned and str keeps its previous content. */
+MUST_USE_RESULT
+str_status_t str_read_fd_fn(str_t *self, int fd);
+
+/* Appends the content of the file at 'path' to str. Returns STR_IO_ERROR
+ * if the file can't be opened or read. */
+MUST_USE_RESULT
+str_status_t str_read_file_fn(str_t *self, const char *path);
+
+/* Writes the content of str to 'fd', continuing after short writes and
+ * interrupted calls. Returns STR_IO_ERROR if writing fails. */
+MUST_USE_RESULT
+str_status_t str_write_fd_fn(const str_t *self, int fd);
+
+/* Writes the contents of the 'num_strs' strings in 'strs' to 'fd' in order.
+ * Up to 64 strings are passed to a single writev() call. Short writes are
+ * continued. Returns STR_IO_ERROR if writing fails. */
+MUST_USE_RESULT
+str_status_t str_writev_fd_fn(int fd, const str_t **strs, ulong num_strs);
+
+/* Sets 'hash' to a 64-bit hash (wyhash) of the content of str.
+ * The value is cached and recomputed only after str has been modified. */
+MUST_USE_RESULT
+str_status_t str_hash_fn(const str_t *self, ulong *hash);
+
+/* Makes str immutable. Operations that would change its content return
+ * STR_IMMUTABLE from then on. */
+MUST_USE_RESULT
+str_status_t str_freeze_fn(str_t *self);
+
+/* Sets 'is_frozen' to true if str is immutable. */
+MUST_USE_RESULT
+str_status_t str_is_frozen_fn(const str_t *self, bool *is_frozen);
+
+/* Sets up 'split' to yield the parts of str between occurrences of the
+ * byte 'delim'. Like every split mode, adjacent delimiters yield empty
+ * tokens, and so does a delimiter at either end. An empty string yields a
+ * single empty token. */
+MUST_USE_RESULT
+str_status_t str_split_fn(const str_t *self, char delim, str_split_t *split);
+
+/* Sets up 'split' to split str on any of the bytes in the null terminated
+ * string 'delims'. */
+MUST_USE_RESULT
+str_status_t str_split_any_fn(const str_t *self, const char *delims, str_split_t *split);
+
+/* Sets up 'split' to split str on occurrences of the string 'sep'.
+ * 'sep' must not be empty and must outlive 'split'. */
+MUST_USE_RESULT
+str_status_t str_split_sep_fn(const str_t *self, const char *sep, str_split_t *split);
+
+/* Sets 'token' to the next token of 'split' and 'has_token' to true,
+ * or 'has_token' to false if all tokens have been returned. */
+MUST_USE_RESULT
+str_status_t str_split_next_fn(str_split_t *split, str_view_t *token, bool *has_token);
+
+/* Stores up to 'max_tokens' of the next tokens of 'split' in 'tokens' and
+ * sets 'num_tokens' to the number stored. Can be called again to continue
+ * where the previous call stopped. */
+MUST_USE_RESULT
+str_status_t str_split_into_fn(
+	str_split_t *split, str_view_t *tokens, ulong max_tokens, ulong *num_tokens
+);
+
+
+/* Creates new instance of str_t.
+ * 'str' must be NULL! */
+MUST_USE_RESULT
+str_status_t create_str(str_t **str);
+
+/* Creates new instance of str_t that takes ownership of 'buf' without
+ * copying it. 'buf' must have been allocated with malloc() and be
+ * 'capacity' bytes long, of which the first 'len' are the content.
+ * 'capacity' must be greater than 'len' as the content is null terminated
+ * at 'buf[len]'. A buffer of at most 16 bytes is copied into the string's
+ * inline storage and freed instead. On failure the caller keeps ownership
+ * of 'buf'.
+ * 'str' must be NULL! */
+MUST_USE_RESULT
+str_status_t create_str_from_owned(str_t **str, char *buf, ulong len, ulong capacity);
+
+/* Creates a new instance of str_t in 'clone' with the content, policy and
+ * allocator of str. Content outside the inline buffer is not copied: both
+ * strings share it through an atomic reference count, and whichever is
+ * modified first makes its own copy. Clearing or releasing a string gives
+ * up the shared buffer without copying it.
+ * Clones may be used from different threads, but a string must not be
+ * cloned while another thread uses it.
+ * 'clone' must be NULL! */
+MUST_USE_RESULT
+str_status_t str_clone_fn(str_t *self, str_t **clone);
+
+/* Creates new instance of str_t that gets all of its memory from
+ * 'allocator'. 'allocator' must outlive the string.
+ * 'str' must be NULL! */
+MUST_USE_RESULT
+str_status_t create_str_with_allocator(str_t **str, const str_allocator_t *allocator);
+
+/* Creates a new arena that allocates memory in chunks of at least
+ * 'chunk_size' bytes.
+ * 'arena' must be NULL! */
+MUST_USE_RESULT
+str_status_t create_str_arena(str_arena_t **arena, ulong chunk_size);
+
+/* Returns the allocator to pass to create_str_with_allocator() to
+ * allocate strings from 'arena'. */
+const str_allocator_t *str_arena_allocator(str_arena_t *arena);
+
+/* Frees everything allocated from 'arena' at once and keeps the chunk it
+ * allocated first for reuse, even if a larger one was allocated later.
+ * Strings allocated from 'arena' become invalid and must not be used or
+ * destroyed afterwards. */
+void str_arena_reset(str_arena_t *arena);
+
+/* Frees 'arena' and everything allocated from it. */
+void str_arena_destroy(str_arena_t **arena);
+
+/* Returns the hash str_hash() gives a string with the content of the
+ * 'len' bytes at 'data'. */
+ulong str_hash_n(const char *data, ulong len);
+
+/* Creates a new, empty intern table.
+ * 'intern' must be NULL! */
+MUST_USE_RESULT
+str_status_t create_str_intern(str_intern_t **intern);
+
+/* Sets 'interned' to the string in 'intern' with the same content as the
+ * null terminated 'src', creating it first if there is none. */
+MUST_USE_RESULT
+str_status_t str_intern_fn(str_intern_t *intern, const char *src, const str_t **interned);
+
+/* Same as str_intern_fn() but takes the first 'len' bytes of 'src', which
+ * may contain null bytes. */
+MUST_USE_RESULT
+str_status_t str_intern_n_fn(
+	str_intern_t *intern, const char *src, ulong len, const str_t **interned
+);
+
+/* Same as str_intern_fn() but takes the content of 'src', reusing its
+ * cached hash. */
+MUST_USE_RESULT
+str_status_t str_intern_str_fn(
+	str_intern_t *intern, const str_t *src, const str_t **interned
+);
+
+/* Sets 'count' to the number of distinct strings in 'intern'. */
+MUST_USE_RESULT
+str_status_t str_intern_count_fn(const str_intern_t *intern, ulong *count);
+
+/* Frees 'intern' and every string interned in it. No other thread may
+ * use 'intern' or its strings during or after the call. */
+void str_intern_destroy(str_intern_t **intern);
+
+/* Prepares the null terminated 'needle' for repeated searches. The needle
+ * is copied. Returns STR_EMPTY if it is empty.
+ * 'pattern' must be NULL! */
+MUST_USE_RESULT
+str_status_t create_str_pattern(str_pattern_t **pattern, const char *needle);
+
+/* Frees 'pattern'. */
+void str_pattern_destroy(str_pattern_t **pattern);
+
+/* Compiles the 'num_patterns' null terminated, non-empty 'patterns' into
+ * a matcher. The patterns are copied into the automaton and need not
+ * outlive it.
+ * 'matcher' must be NULL! */
+MUST_USE_RESULT
+str_status_t create_str_matcher(
+	str_matcher_t **matcher, const char **patterns, ulong num_patterns
+);
+
+/* Frees 'matcher'. */
+void str_matcher_destroy(str_matcher_t **matcher);
+
+/* Creates a new, empty rope.
+ * 'rope' must be NULL! */
+MUST_USE_RESULT
+str_status_t create_str_rope(str_rope_t **rope);
+
+/* Creates a rope with the same content as 'self' that shares all of its
+ * chunks. Takes O(1) time.
+ * 'clone' must be NULL! */
+MUST_USE_RESULT
+str_status_t str_rope_clone_fn(const str_rope_t *self, str_rope_t **clone);
+
+/* Sets 'len' to the number of bytes in rope. */
+MUST_USE_RESULT
+str_status_t str_rope_len_fn(const str_rope_t *self, ulong *len);
+
+/* Appends the null terminated 'src' to rope. Small appends go into the
+ * spare room of the last chunk, so they don't allocate unless a clone or
+ * substring shares that chunk. */
+MUST_USE_RESULT
+str_status_t str_rope_append_fn(str_rope_t *self, const char *src);
+
+/* Appends the first 'len' bytes of 'src' to rope. */
+MUST_USE_RESULT
+str_status_t str_rope_append_n_fn(str_rope_t *self, const char *src, ulong len);
+
+/* Appends a copy of the content of 'src' to rope. */
+MUST_USE_RESULT
+str_status_t str_rope_append_str_fn(str_rope_t *self, const str_t *src);
+
+/* Appends the content of 'src' to rope in O(log n) time. The chunks are
+ * shared, not copied. 'src' may be rope itself. */
+MUST_USE_RESULT
+str_status_t str_rope_concat_fn(str_rope_t *self, const str_rope_t *src);
+
+/* Inserts the first 'len' bytes of 'src' into rope at 'pos'.
+ * Returns STR_OUT_OF_RANGE if 'pos' is past the end of rope. */
+MUST_USE_RESULT
+str_status_t str_rope_insert_n_fn(str_rope_t *self, ulong pos, const char *src, ulong len);
+
+/* Inserts the null terminated 'src' into rope at 'pos'.
+ * Returns STR_OUT_OF_RANGE if 'pos' is past the end of rope. */
+MUST_USE_RESULT
+str_status_t str_rope_insert_str_fn(str_rope_t *self, ulong pos, const char *src);
+
+/* Inserts the content of 'src' into rope at 'pos' in O(log n) time,
+ * sharing its chunks. 'src' may be rope itself.
+ * Returns STR_OUT_OF_RANGE if 'pos' is past the end of rope. */
+MUST_USE_RESULT
+str_status_t str_rope_insert_rope_fn(str_rope_t *self, ulong pos, const str_rope_t *src);
+
+/* Removes 'len' bytes starting at 'pos' from rope in O(log n) time.
+ * Returns STR_OUT_OF_RANGE if the range doesn't fit in rope. */
+MUST_USE_RESULT
+str_status_t str_rope_erase_fn(str_rope_t *self, ulong pos, ulong len);
+
+/* Creates a rope with the 'len' bytes of rope starting at 'pos' in
+ * O(log n) time, sharing the chunks in between.
+ * Returns STR_OUT_OF_RANGE if the range doesn't fit in rope.
+ * 'substr' must be NULL! */
+MUST_USE_RESULT
+str_status_t str_rope_substr_fn(
+	const str_rope_t *self, ulong pos, ulong len, str_rope_t **substr
+);
+
+/* Sets up 'iter' to yield the chunks of rope in order, e.g. to pass them
+ * to write() or writev() without making the content contiguous. */
+MUST_USE_RESULT
+str_status_t str_rope_iter_fn(const str_rope_t *self, str_rope_iter_t *iter);
+
+/* Sets 'chunk' to the next chunk of 'iter' and 'has_chunk' to true, or
+ * 'has_chunk' to false when there are no more chunks. */
+MUST_USE_RESULT
+str_status_t str_rope_iter_next_fn(str_rope_iter_t *iter, str_view_t *chunk, bool *has_chunk);
+
+/* Appends the content of rope to 'dest', growing 'dest' once. */
+MUST_USE_RESULT
+str_status_t str_rope_flatten_fn(const str_rope_t *self, str_t *dest);
+
+/* Frees 'rope'. Chunks shared with other ropes stay alive until the last
+ * rope that uses them is destroyed. */
+void str_rope_destroy(str_rope_t **rope);
+
+/* Creates a line reader that reads from 'fd' with a buffer of
+ * 'buffer_size' bytes, or 64 KB if it is 0. The buffer doubles if a single
+ * line doesn't fit in it. The reader doesn't close 'fd'.
+ * 'reader' must be NULL! */
+MUST_USE_RESULT
+str_status_t create_str_reader(str_reader_t **reader, int fd, ulong buffer_size);
+
+/* Sets 'line' to the next line of the input and 'has_line' to true, or
+ * 'has_line' to false once the input has ended. The '\n' is not part of
+ * the line. The last line doesn't need to end with one. 'line' points
+ * into the reader's buffer and is only valid until the next call.
+ * Interrupted reads are retried, failing ones return STR_IO_ERROR. */
+MUST_USE_RESULT
+str_status_t str_reader_next_fn(str_reader_t *reader, str_view_t *line, bool *has_line);
+
+/* Same as str_reader_next_fn() but replaces the content of 'line' with
+ * the next line. The capacity of 'line' is kept across calls, so reusing
+ * the same string only allocates when a line is longer than any before. */
+MUST_USE_RESULT
+str_status_t str_reader_next_into_fn(str_reader_t *reader, str_t *line, bool *has_line);
+
+/* Frees 'reader'. */
+void str_reader_destroy(str_reader_t **reader);
+
+/* Sets the policy given to strings created after this call.
+ * The default is 2x growth with STR_SHRINK_HYSTERESIS.
+ * Not thread safe, meant to be called once at startup. */
+MUST_USE_RESULT
+str_status_t str_set_default_policy(const str_policy_t *policy);
+
+/* Frees all memory allocated in 'str' */
+void str_destroy(str_t **str);
+
+#ifdef C_STRING_STATS
+/* Copies the counters of the calling thread into 'stats'. */
+void str_stats_snapshot(str_stats_t *stats);
+
+/* Sets the counters of the calling thread to zero. */
+void str_stats_reset(void);
+#endif
+
+#ifdef C_STRING_TESTING
+/* Set by str_destroy() on the calling thread. Only exists in the unit
+ * test build, where it is used for testing str_destroy(). */
+extern _Thread_local bool _is_str_destroyed;
+#endif
 
 
 
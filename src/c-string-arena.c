@@ -0,0 +1,201 @@
+/*
+MIT License
+
+Copyright (c) 2025 broskobandi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* c-string-arena.c
+ * Dynamic string written in C.
+ * Bump allocator implementation */
+
+#include <c-string.h>
+#include <stddef.h>
+#include <string.h>
+
+#define ALIGNMENT _Alignof(max_align_t)
+#define ALIGN_UP(size) (((size) + ALIGNMENT - 1) & ~(ALIGNMENT - 1))
+
+// A chunk of memory that allocations are bumped from.
+// Its usable memory starts CHUNK_HEADER bytes after the struct.
+struct chunk {
+	struct chunk *next;
+	ulong size;
+	ulong used;
+	// Offset of the most recent allocation, which can be resized or
+	// freed in place.
+	ulong last;
+};
+
+#define CHUNK_HEADER ALIGN_UP(sizeof(struct chunk))
+
+// str_arena opaque struct definition
+// 'head' is the chunk allocations currently come from, older chunks
+// follow through 'next'.
+struct str_arena {
+	str_allocator_t allocator;
+	struct chunk *head;
+	ulong chunk_size;
+};
+
+// Function forward declarations
+//// Helpers
+static struct chunk *_new_chunk(str_arena_t *arena, ulong size);
+static char *_chunk_data(struct chunk *chunk);
+static bool _is_last(const str_arena_t *arena, const void *ptr);
+
+//// Allocator functions
+static void *arena_alloc(void *ctx, size_t size);
+static void *arena_realloc(void *ctx, void *ptr, size_t old_size, size_t new_size);
+static void arena_free(void *ctx, void *ptr, size_t size);
+
+// Function definitions
+
+// Constructor
+str_status_t create_str_arena(str_arena_t **arena, ulong chunk_size) {
+	if (!arena) return STR_NULL_PTR;
+	if (*arena) return STR_NOT_EMPTY;
+	if (!chunk_size) return STR_INVALID_ARG;
+
+	*arena = malloc(sizeof(str_arena_t));
+	if (!*arena) return STR_ALLOC_ERROR;
+
+	(*arena)->allocator.alloc = arena_alloc;
+	(*arena)->allocator.realloc = arena_realloc;
+	(*arena)->allocator.free = arena_free;
+	(*arena)->allocator.ctx = *arena;
+	(*arena)->head = NULL;
+	(*arena)->chunk_size = ALIGN_UP(chunk_size);
+
+	return STR_SUCCESS;
+}
+
+// Destructor
+void str_arena_destroy(str_arena_t **arena) {
+	if (arena && *arena) {
+		struct chunk *chunk = (*arena)->head;
+		while (chunk) {
+			struct chunk *next = chunk->next;
+			free(chunk);
+			chunk = next;
+		}
+		free(*arena);
+		*arena = NULL;
+	}
+}
+
+const str_allocator_t *str_arena_allocator(str_arena_t *arena) {
+	if (!arena) return NULL;
+
+	return &arena->allocator;
+}
+
+void str_arena_reset(str_arena_t *arena) {
+	if (!arena || !arena->head) return;
+
+	// The list runs from the newest chunk to the oldest. The newest may
+	// have been sized for one large allocation, so the oldest is kept.
+	struct chunk *chunk = arena->head;
+	while (chunk->next) {
+		struct chunk *next = chunk->next;
+		free(chunk);
+		chunk = next;
+	}
+
+	chunk->used = 0;
+	chunk->last = 0;
+	arena->head = chunk;
+}
+
+// Helpers
+static struct chunk *_new_chunk(str_arena_t *arena, ulong size) {
+	if (size < arena->chunk_size) size = arena->chunk_size;
+
+	struct chunk *chunk = malloc(CHUNK_HEADER + size);
+	if (!chunk) return NULL;
+
+	chunk->next = arena->head;
+	chunk->size = size;
+	chunk->used = 0;
+	chunk->last = 0;
+	arena->head = chunk;
+
+	return chunk;
+}
+
+static char *_chunk_data(struct chunk *chunk) {
+	return (char*)chunk + CHUNK_HEADER;
+}
+
+static bool _is_last(const str_arena_t *arena, const void *ptr) {
+	struct chunk *chunk = arena->head;
+	return chunk && chunk->used && ptr == _chunk_data(chunk) + chunk->last;
+}
+
+// Allocator functions
+static void *arena_alloc(void *ctx, size_t size) {
+	str_arena_t *arena = ctx;
+	ulong aligned = size ? ALIGN_UP(size) : ALIGNMENT;
+
+	struct chunk *chunk = arena->head;
+	if (!chunk || chunk->used + aligned > chunk->size) {
+		chunk = _new_chunk(arena, aligned);
+		if (!chunk) return NULL;
+	}
+
+	chunk->last = chunk->used;
+	chunk->used += aligned;
+
+	return _chunk_data(chunk) + chunk->last;
+}
+
+static void *arena_realloc(void *ctx, void *ptr, size_t old_size, size_t new_size) {
+	str_arena_t *arena = ctx;
+	if (!ptr) return arena_alloc(ctx, new_size);
+
+	// The most recent allocation can grow in place while the chunk has room.
+	if (_is_last(arena, ptr)) {
+		struct chunk *chunk = arena->head;
+		ulong aligned = new_size ? ALIGN_UP(new_size) : ALIGNMENT;
+		if (chunk->last + aligned <= chunk->size) {
+			chunk->used = chunk->last + aligned;
+			return ptr;
+		}
+	}
+
+	if (new_size <= old_size) return ptr;
+
+	void *tmp = arena_alloc(ctx, new_size);
+	if (!tmp) return NULL;
+	memcpy(tmp, ptr, old_size);
+
+	return tmp;
+}
+
+static void arena_free(void *ctx, void *ptr, size_t size) {
+	(void)size;
+	str_arena_t *arena = ctx;
+
+	// Only the most recent allocation can be given back, everything else
+	// is released by str_arena_reset().
+	if (_is_last(arena, ptr)) {
+		arena->head->used = arena->head->last;
+	}
+}
@@ -0,0 +1,300 @@
+/*
+MIT License
+
+Copyright (c) 2025 broskobandi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* c-string-intern.c
+ * Dynamic string written in C.
+ * Intern table implementation */
+
+#include <c-string.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+// The table is split into shards by the top bits of the hash, each with
+// its own lock, so inserts of different keys rarely contend. Lookups take
+// no lock at all.
+#define SHARD_BITS 6
+#define NUM_SHARDS (1 << SHARD_BITS)
+#define INITIAL_CAPACITY 16
+#define CACHE_LINE 64
+
+// A slot of a table. 'hash' is written before 'str' is published and never
+// changes afterwards. Empty slots have a NULL 'str'.
+struct entry {
+	ulong hash;
+	_Atomic(str_t*) str;
+};
+
+// Open addressing with linear probing. 'capacity' is a power of two and
+// a table is kept at most half full. A table that has been replaced by a
+// larger one stays allocated in the 'retired' list until the intern table
+// is destroyed, as readers may still be probing it.
+struct table {
+	ulong capacity;
+	struct table *retired;
+	struct entry entries[];
+};
+
+struct shard {
+	_Alignas(CACHE_LINE) _Atomic(struct table*) table;
+	pthread_mutex_t lock;
+	atomic_ulong count;
+};
+
+// str_intern opaque struct definition
+struct str_intern {
+	struct shard shards[NUM_SHARDS];
+};
+
+// Function forward declarations
+//// Helpers
+static struct table *_new_table(ulong capacity);
+static const str_t *_find(
+	const struct table *table, const char *src, ulong len, ulong hash
+);
+static str_status_t _insert(
+	struct shard *shard, const char *src, ulong len, ulong hash, const str_t **interned
+);
+static str_status_t _grow(struct shard *shard);
+static str_status_t _lookup(
+	str_intern_t *intern, const char *src, ulong len, ulong hash, const str_t **interned
+);
+static str_status_t _new_interned(const char *src, ulong len, str_t **str);
+
+// Function definitions
+
+// Constructor
+str_status_t create_str_intern(str_intern_t **intern) {
+	if (!intern) return STR_NULL_PTR;
+	if (*intern) return STR_NOT_EMPTY;
+
+	*intern = aligned_alloc(CACHE_LINE, sizeof(str_intern_t));
+	if (!*intern) return STR_ALLOC_ERROR;
+
+	for (uint i = 0; i < NUM_SHARDS; i++) {
+		struct shard *shard = &(*intern)->shards[i];
+		struct table *table = _new_table(INITIAL_CAPACITY);
+		if (!table || pthread_mutex_init(&shard->lock, NULL)) {
+			free(table);
+			for (uint j = 0; j < i; j++) {
+				free(atomic_load(&(*intern)->shards[j].table));
+				pthread_mutex_destroy(&(*intern)->shards[j].lock);
+			}
+			free(*intern);
+			*intern = NULL;
+			return STR_ALLOC_ERROR;
+		}
+		atomic_init(&shard->table, table);
+		atomic_init(&shard->count, 0);
+	}
+
+	return STR_SUCCESS;
+}
+
+// Destructor
+void str_intern_destroy(str_intern_t **intern) {
+	if (intern && *intern) {
+		for (uint i = 0; i < NUM_SHARDS; i++) {
+			struct shard *shard = &(*intern)->shards[i];
+			struct table *table = atomic_load(&shard->table);
+			for (ulong j = 0; j < table->capacity; j++) {
+				str_t *str = atomic_load_explicit(
+					&table->entries[j].str, memory_order_relaxed
+				);
+				str_destroy(&str);
+			}
+			while (table) {
+				struct table *retired = table->retired;
+				free(table);
+				table = retired;
+			}
+			pthread_mutex_destroy(&shard->lock);
+		}
+		free(*intern);
+		*intern = NULL;
+	}
+}
+
+// Helpers
+static struct table *_new_table(ulong capacity) {
+	struct table *table =
+		calloc(1, sizeof(struct table) + capacity * sizeof(struct entry));
+	if (!table) return NULL;
+	table->capacity = capacity;
+
+	return table;
+}
+
+// Returns the string in 'table' with the given content or NULL. Safe to
+// call while another thread inserts into the same table.
+static const str_t *_find(
+	const struct table *table, const char *src, ulong len, ulong hash
+) {
+	ulong mask = table->capacity - 1;
+	for (ulong i = hash & mask;; i = (i + 1) & mask) {
+		const struct entry *entry = &table->entries[i];
+		str_t *str = atomic_load_explicit(
+			(_Atomic(str_t*)*)&entry->str, memory_order_acquire
+		);
+		if (!str) return NULL;
+		if (entry->hash != hash) continue;
+		bool is_same = false;
+		if (!str_equals_n_fn(str, src, len, &is_same) && is_same) return str;
+	}
+}
+
+// Adds a string with the given content to 'shard' unless another thread
+// got there first. Must be called with the shard locked.
+static str_status_t _insert(
+	struct shard *shard, const char *src, ulong len, ulong hash, const str_t **interned
+) {
+	struct table *table = atomic_load_explicit(&shard->table, memory_order_relaxed);
+	*interned = _find(table, src, len, hash);
+	if (*interned) return STR_SUCCESS;
+
+	ulong count = atomic_load_explicit(&shard->count, memory_order_relaxed);
+	if ((count + 1) * 2 > table->capacity) {
+		str_status_t status = _grow(shard);
+		if (status) return status;
+		table = atomic_load_explicit(&shard->table, memory_order_relaxed);
+	}
+
+	str_t *str = NULL;
+	str_status_t status = _new_interned(src, len, &str);
+	if (status) return status;
+
+	ulong mask = table->capacity - 1;
+	ulong i = hash & mask;
+	while (atomic_load_explicit(&table->entries[i].str, memory_order_relaxed)) {
+		i = (i + 1) & mask;
+	}
+	table->entries[i].hash = hash;
+	atomic_store_explicit(&table->entries[i].str, str, memory_order_release);
+	atomic_store_explicit(&shard->count, count + 1, memory_order_relaxed);
+	*interned = str;
+
+	return STR_SUCCESS;
+}
+
+// Publishes a table with twice the slots. The stored hashes are reused.
+// Must be called with the shard locked.
+static str_status_t _grow(struct shard *shard) {
+	struct table *old = atomic_load_explicit(&shard->table, memory_order_relaxed);
+	struct table *table = _new_table(old->capacity * 2);
+	if (!table) return STR_ALLOC_ERROR;
+
+	ulong mask = table->capacity - 1;
+	for (ulong i = 0; i < old->capacity; i++) {
+		str_t *str = atomic_load_explicit(&old->entries[i].str, memory_order_relaxed);
+		if (!str) continue;
+		ulong j = old->entries[i].hash & mask;
+		while (atomic_load_explicit(&table->entries[j].str, memory_order_relaxed)) {
+			j = (j + 1) & mask;
+		}
+		table->entries[j].hash = old->entries[i].hash;
+		atomic_init(&table->entries[j].str, str);
+	}
+	table->retired = old;
+	atomic_store_explicit(&shard->table, table, memory_order_release);
+
+	return STR_SUCCESS;
+}
+
+// Looks the content up without locking and only takes the shard lock to
+// insert it. A reader that races with a grow may miss in the old table,
+// in which case the locked path finds it in the new one.
+static str_status_t _lookup(
+	str_intern_t *intern, const char *src, ulong len, ulong hash, const str_t **interned
+) {
+	struct shard *shard = &intern->shards[hash >> (64 - SHARD_BITS)];
+	const struct table *table =
+		atomic_load_explicit(&shard->table, memory_order_acquire);
+	*interned = _find(table, src, len, hash);
+	if (*interned) return STR_SUCCESS;
+
+	pthread_mutex_lock(&shard->lock);
+	str_status_t status = _insert(shard, src, len, hash, interned);
+	pthread_mutex_unlock(&shard->lock);
+
+	return status;
+}
+
+// Interned strings are shared between threads, so their hash is cached
+// before they are published and never written again.
+static str_status_t _new_interned(const char *src, ulong len, str_t **str) {
+	str_status_t status = create_str(str);
+	if (status) return status;
+
+	ulong hash = 0;
+	status = str_append_n_fn(*str, src, len);
+	if (!status) status = str_freeze_fn(*str);
+	if (!status) status = str_hash_fn(*str, &hash);
+	if (status) str_destroy(str);
+
+	return status;
+}
+
+// Associated functions
+str_status_t str_intern_fn(str_intern_t *intern, const char *src, const str_t **interned) {
+	if (!intern || !src || !interned) return STR_NULL_PTR;
+
+	return str_intern_n_fn(intern, src, strlen(src), interned);
+}
+
+str_status_t str_intern_n_fn(
+	str_intern_t *intern, const char *src, ulong len, const str_t **interned
+) {
+	if (!intern || !src || !interned) return STR_NULL_PTR;
+
+	return _lookup(intern, src, len, str_hash_n(src, len), interned);
+}
+
+str_status_t str_intern_str_fn(
+	str_intern_t *intern, const str_t *src, const str_t **interned
+) {
+	if (!intern || !src || !interned) return STR_NULL_PTR;
+
+	ulong hash = 0;
+	const char *data = NULL;
+	ulong len = 0;
+	str_status_t status = str_hash_fn(src, &hash);
+	if (!status) status = str_data_fn(src, &data);
+	if (!status) status = str_len_fn(src, &len);
+	if (status) return status;
+
+	return _lookup(intern, data, len, hash, interned);
+}
+
+str_status_t str_intern_count_fn(const str_intern_t *intern, ulong *count) {
+	if (!intern || !count) return STR_NULL_PTR;
+
+	*count = 0;
+	for (uint i = 0; i < NUM_SHARDS; i++) {
+		*count += atomic_load_explicit(
+			(atomic_ulong*)&intern->shards[i].count, memory_order_relaxed
+		);
+	}
+
+	return STR_SUCCESS;
+}
@@ -0,0 +1,188 @@
+/*
+MIT License
+
+Copyright (c) 2025 broskobandi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* c-string-reader.c
+ * Dynamic string written in C.
+ * Line reader implementation */
+
+#include <c-string.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#define DEFAULT_BUFFER_SIZE (64 * 1024)
+
+// str_reader opaque struct definition
+struct str_reader {
+	char *buf;
+	ulong capacity;
+	// Unconsumed input is buf[begin, end). buf[begin, scan) is known not
+	// to contain a newline, so a line longer than one read isn't scanned
+	// again from its start.
+	ulong begin;
+	ulong scan;
+	ulong end;
+	int fd;
+	bool is_eof;
+};
+
+// Function forward declarations
+//// Helpers
+static str_status_t _refill(str_reader_t *reader);
+static str_status_t _peek(
+	str_reader_t *reader, str_view_t *line, bool *has_line, ulong *next
+);
+
+// Function definitions
+
+// Constructor
+str_status_t create_str_reader(str_reader_t **reader, int fd, ulong buffer_size) {
+	if (!reader) return STR_NULL_PTR;
+	if (*reader) return STR_NOT_EMPTY;
+	if (fd < 0) return STR_INVALID_ARG;
+	if (!buffer_size) buffer_size = DEFAULT_BUFFER_SIZE;
+
+	*reader = malloc(sizeof(str_reader_t));
+	if (!*reader) return STR_ALLOC_ERROR;
+	(*reader)->buf = malloc(buffer_size);
+	if (!(*reader)->buf) {
+		free(*reader);
+		*reader = NULL;
+		return STR_ALLOC_ERROR;
+	}
+	(*reader)->capacity = buffer_size;
+	(*reader)->begin = 0;
+	(*reader)->scan = 0;
+	(*reader)->end = 0;
+	(*reader)->fd = fd;
+	(*reader)->is_eof = false;
+
+	return STR_SUCCESS;
+}
+
+// Destructor
+void str_reader_destroy(str_reader_t **reader) {
+	if (reader && *reader) {
+		free((*reader)->buf);
+		free(*reader);
+		*reader = NULL;
+	}
+}
+
+// Helpers
+// Moves the unconsumed input to the start of the buffer, doubles the
+// buffer if a single line fills it, and reads as much as fits.
+static str_status_t _refill(str_reader_t *reader) {
+	if (reader->begin) {
+		ulong len = reader->end - reader->begin;
+		memmove(reader->buf, &reader->buf[reader->begin], len);
+		reader->scan -= reader->begin;
+		reader->end = len;
+		reader->begin = 0;
+	}
+
+	if (reader->end == reader->capacity) {
+		char *buf = realloc(reader->buf, reader->capacity * 2);
+		if (!buf) return STR_REALLOC_ERROR;
+		reader->buf = buf;
+		reader->capacity *= 2;
+	}
+
+	while (true) {
+		ssize_t num_read = read(
+			reader->fd, &reader->buf[reader->end], reader->capacity - reader->end
+		);
+		if (num_read < 0) {
+			if (errno == EINTR) continue;
+			return STR_IO_ERROR;
+		}
+		if (!num_read) reader->is_eof = true;
+		reader->end += (ulong)num_read;
+		return STR_SUCCESS;
+	}
+}
+
+// Finds the next line without consuming it. 'next' is where the input
+// continues once the line has been used.
+static str_status_t _peek(
+	str_reader_t *reader, str_view_t *line, bool *has_line, ulong *next
+) {
+	while (true) {
+		char *newline = memchr(
+			&reader->buf[reader->scan], '\n', reader->end - reader->scan
+		);
+		if (newline) {
+			line->data = &reader->buf[reader->begin];
+			line->len = (ulong)(newline - line->data);
+			reader->scan = (ulong)(newline - reader->buf);
+			*next = reader->scan + 1;
+			*has_line = true;
+			return STR_SUCCESS;
+		}
+		reader->scan = reader->end;
+
+		if (reader->is_eof) {
+			// The last line doesn't need a newline.
+			*has_line = reader->begin < reader->end;
+			line->data = &reader->buf[reader->begin];
+			line->len = reader->end - reader->begin;
+			*next = reader->end;
+			return STR_SUCCESS;
+		}
+
+		str_status_t status = _refill(reader);
+		if (status) return status;
+	}
+}
+
+// Associated functions
+str_status_t str_reader_next_fn(str_reader_t *reader, str_view_t *line, bool *has_line) {
+	if (!reader || !line || !has_line) return STR_NULL_PTR;
+
+	ulong next;
+	str_status_t status = _peek(reader, line, has_line, &next);
+	if (status) return status;
+	reader->begin = reader->scan = next;
+
+	return STR_SUCCESS;
+}
+
+str_status_t str_reader_next_into_fn(str_reader_t *reader, str_t *line, bool *has_line) {
+	if (!reader || !line || !has_line) return STR_NULL_PTR;
+
+	// The line is only consumed once it has been copied, so a failure
+	// leaves it to be read again.
+	str_view_t view;
+	ulong next;
+	str_status_t status = _peek(reader, &view, has_line, &next);
+	if (status) return status;
+
+	status = str_clear_fn(line);
+	if (!status) status = str_reserve_fn(line, view.len);
+	if (!status && *has_line) status = str_append_view_fn(line, view);
+	if (status) return status;
+	reader->begin = reader->scan = next;
+
+	return STR_SUCCESS;
+}
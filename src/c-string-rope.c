@@ -0,0 +1,522 @@
+/*
+MIT License
+
+Copyright (c) 2025 broskobandi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* c-string-rope.c
+ * Dynamic string written in C.
+ * Rope implementation */
+
+#include <c-string.h>
+#include <string.h>
+#include <stdatomic.h>
+
+// Leaves hold up to this many bytes. Large enough that a rope of a few GB
+// stays at a few hundred thousand nodes, small enough that copying a leaf
+// on an edit is cheap.
+#define LEAF_MAX (16 * 1024)
+
+// A node of a persistent AVL tree. Nodes are never modified once another
+// rope or node can see them, so ropes share subtrees freely and an edit
+// only allocates the O(log n) nodes on its path. Leaves carry the bytes,
+// internal nodes the total length and height of their subtree.
+// The one exception: a leaf that only the caller holds a reference to
+// may have bytes appended in place, which keeps small appends cheap.
+struct str_rope_node {
+	atomic_ulong refs;
+	struct str_rope_node *left;
+	struct str_rope_node *right;
+	ulong len;
+	ulong capacity;
+	uint height;
+	char data[];
+};
+typedef struct str_rope_node node_t;
+
+// str_rope opaque struct definition
+struct str_rope {
+	node_t *root;
+};
+
+// Function forward declarations
+//// Helpers
+// Unless noted otherwise, helpers take over the references they are
+// given and return a new reference.
+static node_t *_ref(node_t *node);
+static void _unref(node_t *node);
+static bool _is_leaf(const node_t *node);
+static ulong _len(const node_t *node);
+static node_t *_new_leaf(const char *data, ulong len, ulong capacity);
+static node_t *_new_node(node_t *left, node_t *right);
+static node_t *_balance(node_t *left, node_t *right);
+static node_t *_concat(node_t *left, node_t *right);
+static bool _split(node_t *node, ulong pos, node_t **left, node_t **right);
+static node_t *_build(const char *data, ulong len, ulong num_leaves);
+static bool _append_in_place(str_rope_t *rope, const char *src, ulong len);
+
+// Function definitions
+
+// Constructor
+str_status_t create_str_rope(str_rope_t **rope) {
+	if (!rope) return STR_NULL_PTR;
+	if (*rope) return STR_NOT_EMPTY;
+
+	*rope = malloc(sizeof(str_rope_t));
+	if (!*rope) return STR_ALLOC_ERROR;
+	(*rope)->root = NULL;
+
+	return STR_SUCCESS;
+}
+
+// Copy constructor
+str_status_t str_rope_clone_fn(const str_rope_t *self, str_rope_t **clone) {
+	if (!self || !clone) return STR_NULL_PTR;
+
+	str_status_t status = create_str_rope(clone);
+	if (status) return status;
+	(*clone)->root = _ref(self->root);
+
+	return STR_SUCCESS;
+}
+
+// Destructor
+void str_rope_destroy(str_rope_t **rope) {
+	if (rope && *rope) {
+		_unref((*rope)->root);
+		free(*rope);
+		*rope = NULL;
+	}
+}
+
+// Helpers
+static node_t *_ref(node_t *node) {
+	if (node) atomic_fetch_add_explicit(&node->refs, 1, memory_order_relaxed);
+	return node;
+}
+
+static void _unref(node_t *node) {
+	while (node && atomic_fetch_sub_explicit(&node->refs, 1, memory_order_acq_rel) == 1) {
+		node_t *right = node->right;
+		_unref(node->left);
+		free(node);
+		// The right subtree is released by the loop to save a level of
+		// recursion.
+		node = right;
+	}
+}
+
+static bool _is_leaf(const node_t *node) {
+	return !node->left;
+}
+
+static ulong _len(const node_t *node) {
+	return node ? node->len : 0;
+}
+
+static node_t *_new_leaf(const char *data, ulong len, ulong capacity) {
+	node_t *leaf = malloc(sizeof(node_t) + capacity);
+	if (!leaf) return NULL;
+	atomic_init(&leaf->refs, 1);
+	leaf->left = NULL;
+	leaf->right = NULL;
+	leaf->len = len;
+	leaf->capacity = capacity;
+	leaf->height = 1;
+	memcpy(leaf->data, data, len);
+
+	return leaf;
+}
+
+// Frees both children if the node can't be allocated.
+static node_t *_new_node(node_t *left, node_t *right) {
+	node_t *node = left && right ? malloc(sizeof(node_t)) : NULL;
+	if (!node) {
+		_unref(left);
+		_unref(right);
+		return NULL;
+	}
+	atomic_init(&node->refs, 1);
+	node->left = left;
+	node->right = right;
+	node->len = left->len + right->len;
+	node->capacity = 0;
+	node->height = 1 + (left->height > right->height ? left->height : right->height);
+
+	return node;
+}
+
+// Joins two balanced trees whose heights differ by at most two into a
+// balanced tree, rotating once or twice if needed.
+static node_t *_balance(node_t *left, node_t *right) {
+	if (!left || !right) {
+		_unref(left);
+		_unref(right);
+		return NULL;
+	}
+
+	if (left->height > right->height + 1) {
+		node_t *ll = _ref(left->left);
+		node_t *lr = _ref(left->right);
+		_unref(left);
+		if (ll->height >= lr->height) return _new_node(ll, _new_node(lr, right));
+		node_t *lrl = _ref(lr->left);
+		node_t *lrr = _ref(lr->right);
+		_unref(lr);
+		return _new_node(_new_node(ll, lrl), _new_node(lrr, right));
+	}
+	if (right->height > left->height + 1) {
+		node_t *rl = _ref(right->left);
+		node_t *rr = _ref(right->right);
+		_unref(right);
+		if (rr->height >= rl->height) return _new_node(_new_node(left, rl), rr);
+		node_t *rll = _ref(rl->left);
+		node_t *rlr = _ref(rl->right);
+		_unref(rl);
+		return _new_node(_new_node(left, rll), _new_node(rlr, rr));
+	}
+
+	return _new_node(left, right);
+}
+
+// Concatenates two trees in O(|height difference|). Adjacent leaves that
+// fit in one are merged, so appending small pieces doesn't leave a leaf
+// per piece. Either tree may be NULL (empty). Returns NULL with both
+// trees released if an allocation fails, which the callers tell apart
+// from an empty result by the lengths.
+static node_t *_concat(node_t *left, node_t *right) {
+	if (!left) return right;
+	if (!right) return left;
+
+	if (_is_leaf(left) && _is_leaf(right) && left->len + right->len <= LEAF_MAX) {
+		node_t *merged = left;
+		bool is_owned = atomic_load_explicit(&left->refs, memory_order_acquire) == 1;
+		if (!is_owned || left->len + right->len > left->capacity) {
+			merged = _new_leaf(left->data, left->len, LEAF_MAX);
+			_unref(left);
+		}
+		if (merged) {
+			memcpy(&merged->data[merged->len], right->data, right->len);
+			merged->len += right->len;
+		}
+		_unref(right);
+		return merged;
+	}
+
+	// A leaf is pushed down to the nearest leaf of the other tree so that
+	// it can be merged with it.
+	if (left->height > right->height + 1 || (_is_leaf(right) && !_is_leaf(left))) {
+		node_t *ll = _ref(left->left);
+		node_t *lr = _ref(left->right);
+		_unref(left);
+		return _balance(ll, _concat(lr, right));
+	}
+	if (right->height > left->height + 1 || (_is_leaf(left) && !_is_leaf(right))) {
+		node_t *rl = _ref(right->left);
+		node_t *rr = _ref(right->right);
+		_unref(right);
+		return _balance(_concat(left, rl), rr);
+	}
+
+	return _new_node(left, right);
+}
+
+// Splits 'node' into the trees holding its first 'pos' bytes and the rest.
+// Returns false with both released if an allocation fails.
+static bool _split(node_t *node, ulong pos, node_t **left, node_t **right) {
+	*left = NULL;
+	*right = NULL;
+	if (!node) return true;
+	if (!pos) {
+		*right = node;
+		return true;
+	}
+	if (pos >= node->len) {
+		*left = node;
+		return true;
+	}
+
+	if (_is_leaf(node)) {
+		*left = _new_leaf(node->data, pos, pos);
+		*right = _new_leaf(&node->data[pos], node->len - pos, node->len - pos);
+		_unref(node);
+	} else {
+		node_t *l = _ref(node->left);
+		node_t *r = _ref(node->right);
+		_unref(node);
+		node_t *a = NULL;
+		node_t *b = NULL;
+		if (pos <= l->len) {
+			if (!_split(l, pos, &a, &b)) {
+				_unref(r);
+				return false;
+			}
+			*left = a;
+			*right = _concat(b, r);
+		} else {
+			if (!_split(r, pos - l->len, &a, &b)) {
+				_unref(l);
+				return false;
+			}
+			*left = _concat(l, a);
+			*right = b;
+		}
+	}
+
+	if (!*left || !*right) {
+		_unref(*left);
+		_unref(*right);
+		*left = NULL;
+		*right = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+// Builds a perfectly balanced tree over 'num_leaves' full leaves of 'data',
+// the last of which may be shorter.
+static node_t *_build(const char *data, ulong len, ulong num_leaves) {
+	if (num_leaves == 1) return _new_leaf(data, len, len);
+
+	ulong left_leaves = num_leaves / 2;
+	ulong left_len = left_leaves * LEAF_MAX;
+	node_t *left = _build(data, left_len, left_leaves);
+	node_t *right = left ? _build(data + left_len, len - left_len, num_leaves - left_leaves) : NULL;
+	if (!right) {
+		_unref(left);
+		return NULL;
+	}
+
+	return _new_node(left, right);
+}
+
+// Appends to the last leaf without allocating if it has room and nothing
+// but 'rope' can see it or the nodes above it, so no one can observe the
+// change. Doesn't take or release references.
+static bool _append_in_place(str_rope_t *rope, const char *src, ulong len) {
+	node_t *node = rope->root;
+	while (node && atomic_load_explicit(&node->refs, memory_order_acquire) == 1) {
+		if (!_is_leaf(node)) {
+			node = node->right;
+			continue;
+		}
+		if (node->capacity - node->len < len) return false;
+
+		memcpy(&node->data[node->len], src, len);
+		for (node = rope->root; !_is_leaf(node); node = node->right) node->len += len;
+		node->len += len;
+		return true;
+	}
+
+	return false;
+}
+
+// Associated functions
+str_status_t str_rope_len_fn(const str_rope_t *self, ulong *len) {
+	if (!self || !len) return STR_NULL_PTR;
+
+	*len = _len(self->root);
+
+	return STR_SUCCESS;
+}
+
+str_status_t str_rope_insert_rope_fn(str_rope_t *self, ulong pos, const str_rope_t *src) {
+	if (!self || !src) return STR_NULL_PTR;
+	ulong len = _len(self->root);
+	ulong src_len = _len(src->root);
+	if (pos > len) return STR_OUT_OF_RANGE;
+	if (!src_len) return STR_SUCCESS;
+
+	node_t *left = NULL;
+	node_t *right = NULL;
+	if (!_split(_ref(self->root), pos, &left, &right)) return STR_ALLOC_ERROR;
+	node_t *root = _concat(_concat(left, _ref(src->root)), right);
+	if (!root) return STR_ALLOC_ERROR;
+
+	_unref(self->root);
+	self->root = root;
+
+	return STR_SUCCESS;
+}
+
+str_status_t str_rope_insert_n_fn(str_rope_t *self, ulong pos, const char *src, ulong len) {
+	if (!self || !src) return STR_NULL_PTR;
+	if (pos > _len(self->root)) return STR_OUT_OF_RANGE;
+	if (!len) return STR_SUCCESS;
+
+	str_rope_t piece = {
+		.root = _build(src, len, (len + LEAF_MAX - 1) / LEAF_MAX)
+	};
+	if (!piece.root) return STR_ALLOC_ERROR;
+	str_status_t status = str_rope_insert_rope_fn(self, pos, &piece);
+	_unref(piece.root);
+
+	return status;
+}
+
+str_status_t str_rope_insert_str_fn(str_rope_t *self, ulong pos, const char *src) {
+	if (!self || !src) return STR_NULL_PTR;
+
+	return str_rope_insert_n_fn(self, pos, src, strlen(src));
+}
+
+str_status_t str_rope_append_n_fn(str_rope_t *self, const char *src, ulong len) {
+	if (!self || !src) return STR_NULL_PTR;
+	if (!len || _append_in_place(self, src, len)) return STR_SUCCESS;
+	if (len >= LEAF_MAX) return str_rope_insert_n_fn(self, _len(self->root), src, len);
+
+	// The new leaf gets room for the appends that follow it.
+	node_t *leaf = _new_leaf(src, len, LEAF_MAX);
+	if (!leaf) return STR_ALLOC_ERROR;
+	node_t *root = _concat(_ref(self->root), leaf);
+	if (!root) return STR_ALLOC_ERROR;
+
+	_unref(self->root);
+	self->root = root;
+
+	return STR_SUCCESS;
+}
+
+str_status_t str_rope_append_fn(str_rope_t *self, const char *src) {
+	if (!self || !src) return STR_NULL_PTR;
+
+	return str_rope_append_n_fn(self, src, strlen(src));
+}
+
+str_status_t str_rope_append_str_fn(str_rope_t *self, const str_t *src) {
+	if (!self || !src) return STR_NULL_PTR;
+
+	const char *data = NULL;
+	ulong len = 0;
+	str_status_t status = str_data_fn(src, &data);
+	if (!status) status = str_len_fn(src, &len);
+	if (status) return status;
+
+	return str_rope_append_n_fn(self, data, len);
+}
+
+str_status_t str_rope_concat_fn(str_rope_t *self, const str_rope_t *src) {
+	if (!self) return STR_NULL_PTR;
+
+	return str_rope_insert_rope_fn(self, _len(self->root), src);
+}
+
+str_status_t str_rope_erase_fn(str_rope_t *self, ulong pos, ulong len) {
+	if (!self) return STR_NULL_PTR;
+	ulong rope_len = _len(self->root);
+	if (pos > rope_len || len > rope_len - pos) return STR_OUT_OF_RANGE;
+	if (!len) return STR_SUCCESS;
+
+	node_t *left = NULL;
+	node_t *rest = NULL;
+	node_t *erased = NULL;
+	node_t *right = NULL;
+	if (!_split(_ref(self->root), pos, &left, &rest)) return STR_ALLOC_ERROR;
+	if (!_split(rest, len, &erased, &right)) {
+		_unref(left);
+		return STR_ALLOC_ERROR;
+	}
+	_unref(erased);
+	node_t *root = _concat(left, right);
+	if (!root && len < rope_len) return STR_ALLOC_ERROR;
+
+	_unref(self->root);
+	self->root = root;
+
+	return STR_SUCCESS;
+}
+
+str_status_t str_rope_substr_fn(
+	const str_rope_t *self, ulong pos, ulong len, str_rope_t **substr
+) {
+	if (!self || !substr) return STR_NULL_PTR;
+	if (*substr) return STR_NOT_EMPTY;
+	ulong rope_len = _len(self->root);
+	if (pos > rope_len || len > rope_len - pos) return STR_OUT_OF_RANGE;
+
+	node_t *before = NULL;
+	node_t *rest = NULL;
+	node_t *middle = NULL;
+	node_t *after = NULL;
+	if (!_split(_ref(self->root), pos, &before, &rest)) return STR_ALLOC_ERROR;
+	_unref(before);
+	if (!_split(rest, len, &middle, &after)) return STR_ALLOC_ERROR;
+	_unref(after);
+
+	str_status_t status = create_str_rope(substr);
+	if (status) {
+		_unref(middle);
+		return status;
+	}
+	(*substr)->root = middle;
+
+	return STR_SUCCESS;
+}
+
+str_status_t str_rope_iter_fn(const str_rope_t *self, str_rope_iter_t *iter) {
+	if (!self || !iter) return STR_NULL_PTR;
+
+	iter->depth = 0;
+	if (self->root) iter->stack[iter->depth++] = self->root;
+
+	return STR_SUCCESS;
+}
+
+str_status_t str_rope_iter_next_fn(str_rope_iter_t *iter, str_view_t *chunk, bool *has_chunk) {
+	if (!iter || !chunk || !has_chunk) return STR_NULL_PTR;
+
+	*has_chunk = iter->depth > 0;
+	if (!*has_chunk) return STR_SUCCESS;
+
+	// The stack holds the subtrees still to be visited, the next one on
+	// top. It never holds more than one node per level.
+	const node_t *node = iter->stack[--iter->depth];
+	while (!_is_leaf(node)) {
+		iter->stack[iter->depth++] = node->right;
+		node = node->left;
+	}
+	chunk->data = node->data;
+	chunk->len = node->len;
+
+	return STR_SUCCESS;
+}
+
+str_status_t str_rope_flatten_fn(const str_rope_t *self, str_t *dest) {
+	if (!self || !dest) return STR_NULL_PTR;
+
+	ulong len = 0;
+	str_status_t status = str_len_fn(dest, &len);
+	if (!status) status = str_reserve_fn(dest, len + _len(self->root));
+	if (status) return status;
+
+	str_rope_iter_t iter;
+	status = str_rope_iter_fn(self, &iter);
+	str_view_t chunk;
+	bool has_chunk = false;
+	if (!status) status = str_rope_iter_next_fn(&iter, &chunk, &has_chunk);
+	while (!status && has_chunk) {
+		status = str_append_view_fn(dest, chunk);
+		if (!status) status = str_rope_iter_next_fn(&iter, &chunk, &has_chunk);
+	}
+
+	return status;
+}
@@ -26,300 +26,2030 @@ SOFTWARE.
  * Dynamic string written in C.
  * Implementation */
 
+#define _GNU_SOURCE
 #include <c-string.h>
 #include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
 #define DEFAULT_CAPACITY 16
 
-// str_priv opaque struct definition
-struct str_priv {
+// Instrumentation
+// With C_STRING_STATS defined every thread counts the memory work done on
+// its behalf. Otherwise the macros expand to nothing.
+#ifdef C_STRING_STATS
+static _Thread_local str_stats_t _stats;
+#define STATS_ADD(counter, n) (_stats.counter += (n))
+#define STATS_CAPACITY(capacity)\
+	do {\
+		if ((capacity) > _stats.peak_capacity) _stats.peak_capacity = (capacity);\
+	} while (0)
+#else
+#define STATS_ADD(counter, n) ((void)0)
+#define STATS_CAPACITY(capacity) ((void)0)
+#endif
+
+// Smallest amount of spare capacity read_fd() asks the kernel to fill
+// when the size of the input is not known up front.
+#define READ_CHUNK 4096
+
+// Number of strings writev_fd() passes to a single writev() call.
+#define WRITEV_BATCH 64
+
+// Needles longer than this are handed to memmem() directly. The SIMD
+// kernels verify every candidate with memcmp(), which degrades to
+// O(n * m) on repetitive input, while memmem() is linear in all cases.
+#define SIMD_SEARCH_MAX_NEEDLE 32
+
+// Transitions of a str_matcher_t are row offsets (state * num_classes), so
+// the scan loop needs no multiplication. The top bit marks states at which
+// a pattern ends.
+#define MATCH_FLAG 0x80000000u
+#define MATCH_MAX_ENTRIES MATCH_FLAG
+
+// Hash of the two bytes ending at 'p' for the shift table of a str_pattern.
+#define PAIR_HASH(p)\
+	((uint)(unsigned char)((unsigned char)(p)[0] - ((unsigned char)(p)[-1] << 3)))
+
+// Heap buffer shared between a string and its clones. It is allocated by
+// the first clone() of a string and freed with the buffer by the last
+// string that lets go of it.
+struct shared {
+	atomic_ulong refs;
+};
+
+// str opaque struct definition
+// Strings that fit in DEFAULT_CAPACITY bytes (terminator included) are
+// stored in 'small' and 'data' points at it. Once the content outgrows it,
+// 'data' is moved to the heap by _handle_realloc().
+struct str {
 	char *data;
 	ulong len;
 	ulong capacity;
+	str_policy_t policy;
+	const str_allocator_t *allocator;
+	// Cached result of str_hash(), valid while 'has_hash' is set.
+	ulong hash;
+	bool has_hash;
+	bool is_immutable;
+	// Set while the heap buffer may be shared with clones. The buffer
+	// must not be written to or resized until _unshare() has been called.
+	struct shared *shared;
+	char small[DEFAULT_CAPACITY];
+};
+
+// str_pattern opaque struct definition
+// Needles short enough for the SIMD kernels need nothing but their length.
+// Longer ones are searched with Horspool on pairs of bytes, whose shift
+// table is built once. Pairs are hashed into 256 slots, which is far more
+// selective than single bytes for text needles.
+// str_replace_fn() keeps one on the stack, which isn't initialized past
+// what the needle needs.
+struct str_pattern {
+	const char *data;
+	ulong len;
+	// How far the window can move after a failed candidate.
+	ulong shift_on_miss;
+	ulong shift[256];
+	// Owned copy of the needle for patterns made by create_str_pattern().
+	char owned[];
+};
+
+// str_matcher opaque struct definition
+// An Aho-Corasick automaton with the failure links folded into a full
+// transition table, so every input byte costs one lookup whatever the
+// number of patterns. Bytes that occur in no pattern share a class, which
+// keeps rows short for typical pattern sets.
+struct str_matcher {
+	unsigned char byte_class[256];
+	// Bytes that leave the root state. While no match is in progress the
+	// scan skips everything else, with memchr() if there is a single one.
+	bool is_start[256];
+	int only_start;
+	ulong num_classes;
+	ulong num_states;
+	uint32_t *next;
+	// Index of the longest pattern that ends at a state, or -1.
+	long *pattern;
+	ulong *pattern_lens;
+	ulong num_patterns;
+};
+
+// Two digit decimal strings from "00" to "99" for _format_uint().
+static const char _digit_pairs[] =
+	"0001020304050607080910111213141516171819"
+	"2021222324252627282930313233343536373839"
+	"4041424344454647484950515253545556575859"
+	"6061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+// Policy given to new strings. Can be changed with str_set_default_policy().
+static str_policy_t _default_policy = {
+	.growth_percent = 200,
+	.shrink = STR_SHRINK_HYSTERESIS
+};
+
+// Allocator used by create_str().
+static void *_default_alloc(void *ctx, size_t size);
+static void *_default_realloc(void *ctx, void *ptr, size_t old_size, size_t new_size);
+static void _default_free(void *ctx, void *ptr, size_t size);
+static const str_allocator_t _default_allocator = {
+	.alloc = _default_alloc,
+	.realloc = _default_realloc,
+	.free = _default_free,
+	.ctx = NULL
 };
 
 // Function forward declarations
 //// Helpers
-static str_status_t _alloc(str_t **str, ulong capacity);
+static str_status_t _alloc(str_t **str, const str_allocator_t *allocator);
+static void *_mem_alloc(const str_t *str, ulong size);
+static void *_mem_realloc(const str_t *str, void *ptr, ulong old_size, ulong new_size);
+static void _mem_free(const str_t *str, void *ptr, ulong size);
 static void _init(str_t *str, ulong capacity);
+static bool _is_small(const str_t *str);
 static str_status_t _handle_realloc(
 	str_t *str, ulong old_capacity, ulong *new_capacity, ulong new_len
 );
-
-//// Associated functions
-static str_status_t append(str_t *self, const char *src);
-static str_status_t replace(str_t *self, const char *old_str, const char *new_str);
-static str_status_t data(const str_t *self, const char **dest);
-static str_status_t len(const str_t *self, ulong *len);
-static str_status_t capacity(const str_t *self, ulong *capacity);
-static str_status_t push(str_t *self, char c);
-static str_status_t pop(str_t *self, char *c);
-static str_status_t clear(str_t *self);
-static str_status_t cmp(const str_t *self, const char *pattern, bool *is_same);
-static str_status_t has(const str_t *self, const char *pattern, bool *has);
+static str_status_t _set_capacity(str_t *str, ulong old_capacity, ulong new_capacity);
+static bool _is_valid_policy(const str_policy_t *policy);
+static const char *_search(
+	const char *haystack, ulong haystack_len, const char *needle, ulong needle_len
+);
+static const char *_search_scalar(
+	const char *haystack, ulong haystack_len, const char *needle, ulong needle_len
+);
+#if defined(__x86_64__)
+static const char *_search_sse2(
+	const char *haystack, ulong haystack_len, const char *needle, ulong needle_len
+);
+static const char *_search_avx2(
+	const char *haystack, ulong haystack_len, const char *needle, ulong needle_len
+);
+#endif
+static void _pattern_init(str_pattern_t *pattern, const char *needle, ulong len);
+static const char *_pattern_search(
+	const str_pattern_t *pattern, const char *haystack, ulong haystack_len
+);
+static ulong _replace_into(
+	char *dest, const char *src, ulong src_len,
+	const str_pattern_t *old, const char *new_str, ulong new_str_len
+);
+static str_status_t _replace(
+	str_t *str, const str_pattern_t *old, const char *new_str, ulong new_str_len
+);
+static void _split_init(const str_t *str, str_split_mode_t mode, str_split_t *split);
+static ulong _format_uint(char *end, ulong value);
+static str_status_t _write_all(int fd, const char *data, ulong len);
+static str_status_t _mutate(str_t *str, bool keep_content);
+static str_status_t _unshare(str_t *str);
+static void _drop_buffer(str_t *str);
+static ulong _hash(const char *data, ulong len);
+static str_status_t _append_parts(
+	str_t *str, const char *sep, const char **parts, const ulong *lens, ulong num_parts
+);
+static const char *_split_find(const str_split_t *split, const char *from, ulong len);
+static const char *_matcher_next(
+	const str_matcher_t *matcher, const char *data, const char *end, ulong *pattern
+);
+static str_status_t _replace_all_map(
+	str_t *str, const str_matcher_t *matcher, const char **replacements, const ulong *lens
+);
 
 // Function definitions
 
 // Constructor
 
 str_status_t create_str(str_t **str) {
+	return create_str_with_allocator(str, &_default_allocator);
+}
+
+str_status_t create_str_with_allocator(str_t **str, const str_allocator_t *allocator) {
+	if (!str || !allocator) return STR_NULL_PTR;
 	if (*str) return STR_NOT_EMPTY;
 
-	str_status_t status = _alloc(str, DEFAULT_CAPACITY);
+	str_status_t status = _alloc(str, allocator);
 	if (status) return status;
 
 	_init(*str, DEFAULT_CAPACITY);
+	STATS_ADD(calls.create, 1);
+
+	return STR_SUCCESS;
+}
+
+str_status_t create_str_from_owned(str_t **str, char *buf, ulong len, ulong capacity) {
+	if (!str || !buf) return STR_NULL_PTR;
+	if (*str) return STR_NOT_EMPTY;
+	if (len >= capacity) return STR_INVALID_ARG;
+
+	str_status_t status = _alloc(str, &_default_allocator);
+	if (status) return status;
+
+	// Heap buffers are always larger than the inline one, which is what
+	// _set_capacity() relies on when it moves content back into it.
+	if (capacity <= DEFAULT_CAPACITY) {
+		_init(*str, DEFAULT_CAPACITY);
+		memcpy((*str)->small, buf, len);
+		free(buf);
+	} else {
+		_init(*str, capacity);
+		(*str)->data = buf;
+		STATS_CAPACITY(capacity);
+	}
+	(*str)->data[len] = '\0';
+	(*str)->len = len;
+	STATS_ADD(calls.create, 1);
+
+	return STR_SUCCESS;
+}
+
+// Copy constructor
+str_status_t str_clone_fn(str_t *self, str_t **clone) {
+	if (!self || !clone) return STR_NULL_PTR;
+	if (*clone) return STR_NOT_EMPTY;
+
+	if (!_is_small(self) && !self->shared) {
+		struct shared *shared = _mem_alloc(self, sizeof(struct shared));
+		if (!shared) return STR_ALLOC_ERROR;
+		atomic_init(&shared->refs, 1);
+		self->shared = shared;
+	}
+
+	str_status_t status = _alloc(clone, self->allocator);
+	if (status) return status;
+
+	str_t *copy = *clone;
+	copy->len = self->len;
+	copy->capacity = self->capacity;
+	copy->policy = self->policy;
+	copy->hash = self->hash;
+	copy->has_hash = self->has_hash;
+	if (_is_small(self)) {
+		memcpy(copy->small, self->small, DEFAULT_CAPACITY * sizeof(char));
+	} else {
+		atomic_fetch_add_explicit(&self->shared->refs, 1, memory_order_relaxed);
+		copy->data = self->data;
+		copy->shared = self->shared;
+	}
+	STATS_ADD(calls.clone, 1);
+
+	return STR_SUCCESS;
+}
+
+// Global configuration
+str_status_t str_set_default_policy(const str_policy_t *policy) {
+	if (!policy) return STR_NULL_PTR;
+	if (!_is_valid_policy(policy)) return STR_INVALID_ARG;
+
+	_default_policy = *policy;
 
 	return STR_SUCCESS;
 }
 
+// Instrumentation
+#ifdef C_STRING_STATS
+void str_stats_snapshot(str_stats_t *stats) {
+	if (stats) *stats = _stats;
+}
+
+void str_stats_reset(void) {
+	memset(&_stats, 0, sizeof(_stats));
+}
+#endif
+
 // Destructor
-bool _is_str_destroyed = false;
+// Test builds record destruction in a thread-local flag. Nothing shared is
+// written on the destroy path of a normal build.
+#ifdef C_STRING_TESTING
+_Thread_local bool _is_str_destroyed = false;
+#endif
 void str_destroy(str_t **str) {
-	if (*str && str) {
-		if ((*str)->priv) {
-			if ((*str)->priv->data) {
-				free((*str)->priv->data);
-			}
-			free((*str)->priv);
-		}
-		free(*str);
+	if (str && *str) {
+		_drop_buffer(*str);
+		const str_allocator_t *allocator = (*str)->allocator;
+		allocator->free(allocator->ctx, *str, sizeof(str_t));
+		STATS_ADD(frees, 1);
+		STATS_ADD(calls.destroy, 1);
 		*str = NULL;
+#ifdef C_STRING_TESTING
 		_is_str_destroyed = true;
+#endif
 	}
 }
 
 // Helpers
-static str_status_t _alloc(str_t **str, ulong capacity) {
-	*str = calloc(1, sizeof(str_t));
-	if (!str) return STR_ALLOC_ERROR;
+static str_status_t _alloc(str_t **str, const str_allocator_t *allocator) {
+	*str = allocator->alloc(allocator->ctx, sizeof(str_t));
+	if (!*str) return STR_ALLOC_ERROR;
+	STATS_ADD(allocs, 1);
+	STATS_ADD(bytes_allocated, sizeof(str_t));
+	memset(*str, 0, sizeof(str_t));
 
-	(*str)->priv = calloc(1, sizeof(str_priv_t));
-	if (!(*str)->priv) {
-		str_destroy(str);
-		return STR_ALLOC_ERROR;
-	}
-
-	(*str)->priv->data = calloc(capacity, sizeof(char));
-	if (!(*str)->priv->data) {
-		str_destroy(str);
-		return STR_ALLOC_ERROR;
-	}
+	(*str)->data = (*str)->small;
+	(*str)->allocator = allocator;
 
 	return STR_SUCCESS;
 }
 
+static void *_mem_alloc(const str_t *str, ulong size) {
+	const str_allocator_t *allocator = str->allocator;
+	STATS_ADD(allocs, 1);
+	STATS_ADD(bytes_allocated, size);
+	return allocator->alloc(allocator->ctx, size);
+}
+
+static void *_mem_realloc(const str_t *str, void *ptr, ulong old_size, ulong new_size) {
+	const str_allocator_t *allocator = str->allocator;
+	STATS_ADD(reallocs, 1);
+	STATS_ADD(bytes_allocated, new_size);
+	return allocator->realloc(allocator->ctx, ptr, old_size, new_size);
+}
+
+static void _mem_free(const str_t *str, void *ptr, ulong size) {
+	const str_allocator_t *allocator = str->allocator;
+	STATS_ADD(frees, 1);
+	allocator->free(allocator->ctx, ptr, size);
+}
+
+static void *_default_alloc(void *ctx, size_t size) {
+	(void)ctx;
+	return malloc(size);
+}
+
+static void *_default_realloc(void *ctx, void *ptr, size_t old_size, size_t new_size) {
+	(void)ctx;
+	(void)old_size;
+	return realloc(ptr, new_size);
+}
+
+static void _default_free(void *ctx, void *ptr, size_t size) {
+	(void)ctx;
+	(void)size;
+	free(ptr);
+}
+
 static void _init(str_t *str, ulong c) {
-	str->priv->capacity = c;
-	str->priv->len = 0;
+	str->capacity = c;
+	str->len = 0;
+	str->policy = _default_policy;
 
-	str->append = append;
-	str->replace = replace;
-	str->data = data;
-	str->len = len;
-	str->capacity = capacity;
-	str->push = push;
-	str->pop = pop;
-	str->clear = clear;
-	str->cmp = cmp;
-	str->has = has;
+}
+
+static bool _is_small(const str_t *str) {
+	return str->data == str->small;
 }
 
 static str_status_t _handle_realloc(
 	str_t *str, ulong old_capacity, ulong *new_capacity, ulong new_len
 ) {
-	while (new_len + 1 > *new_capacity) {
-		*new_capacity *= 2;
+	const str_policy_t *policy = &str->policy;
+
+	if (new_len + 1 > old_capacity) {
+		while (new_len + 1 > *new_capacity) {
+			ulong grown = *new_capacity * policy->growth_percent / 100;
+			*new_capacity = grown > *new_capacity ? grown : *new_capacity + 1;
+		}
+	} else if (new_len < str->len && old_capacity > DEFAULT_CAPACITY) {
+		// Only operations that shorten the content shrink the buffer, so
+		// room made with reserve() survives appends.
+		// The hysteresis band keeps a string that oscillates around a
+		// boundary from reallocating on every push/pop.
+		bool should_shrink =
+			(policy->shrink == STR_SHRINK_EAGER && new_len + 1 < old_capacity / 2) ||
+			(policy->shrink == STR_SHRINK_HYSTERESIS && new_len + 1 <= old_capacity / 4);
+		if (should_shrink) {
+			*new_capacity = old_capacity / 2;
+			if (*new_capacity < DEFAULT_CAPACITY) *new_capacity = DEFAULT_CAPACITY;
+		}
 	}
 
-	if (new_len + 1 < *new_capacity / 2 && *new_capacity / 2 >= DEFAULT_CAPACITY) {
-		*new_capacity /= 2;
+	if (*new_capacity == old_capacity) return STR_SUCCESS;
+
+	str_status_t status = _set_capacity(str, old_capacity, *new_capacity);
+	if (status && *new_capacity < old_capacity) {
+		// Failing to give memory back is not an error, keep the old buffer.
+		*new_capacity = old_capacity;
+		return STR_SUCCESS;
 	}
 
-	if (*new_capacity != old_capacity) {
-		char *tmp = (char*)realloc(str->priv->data, *new_capacity * sizeof(char));
+	return status;
+}
+
+// Moves the content into a buffer of 'new_capacity' bytes. Does not
+// update str->capacity.
+static str_status_t _set_capacity(str_t *str, ulong old_capacity, ulong new_capacity) {
+	if (_is_small(str)) {
+		// Spill the inline buffer to the heap.
+		char *tmp = (char*)_mem_alloc(str, new_capacity * sizeof(char));
+		if (!tmp) return STR_REALLOC_ERROR;
+		memcpy(tmp, str->small, old_capacity * sizeof(char));
+		STATS_ADD(bytes_copied, old_capacity);
+		str->data = tmp;
+	} else if (new_capacity == DEFAULT_CAPACITY) {
+		// Shrunk back to the default capacity, move back to the inline buffer.
+		memcpy(str->small, str->data, DEFAULT_CAPACITY * sizeof(char));
+		STATS_ADD(bytes_copied, DEFAULT_CAPACITY);
+		_mem_free(str, str->data, old_capacity * sizeof(char));
+		str->data = str->small;
+	} else {
+		char *tmp = (char*)_mem_realloc(
+			str, str->data, old_capacity * sizeof(char), new_capacity * sizeof(char)
+		);
 		if (!tmp) return STR_REALLOC_ERROR;
-		str->priv->data = tmp;
+		str->data = tmp;
 	}
 
+	STATS_ADD(grows, new_capacity > old_capacity);
+	STATS_ADD(shrinks, new_capacity < old_capacity);
+	STATS_CAPACITY(new_capacity);
+
 	return STR_SUCCESS;
 }
 
-// Associated functions
-static str_status_t append(str_t *self, const char *src) {
-	if (!self || !src) return STR_NULL_PTR;
+static bool _is_valid_policy(const str_policy_t *policy) {
+	return policy->growth_percent > 100 && (
+		policy->shrink == STR_SHRINK_NEVER ||
+		policy->shrink == STR_SHRINK_HYSTERESIS ||
+		policy->shrink == STR_SHRINK_EAGER
+	);
+}
 
-	ulong old_len = self->priv->len;
-	ulong old_capacity = self->priv->capacity;
-	ulong new_len = old_len + strlen(src);
-	ulong new_capacity = old_capacity;
+// Search kernels
+// The kernel used by _search() is picked once at startup based on the
+// features of the CPU the library runs on.
+typedef const char *(*search_fn_t)(
+	const char *haystack, ulong haystack_len, const char *needle, ulong needle_len
+);
+#if defined(__x86_64__)
+static search_fn_t _search_kernel = _search_sse2;
+#else
+static search_fn_t _search_kernel = _search_scalar;
+#endif
+
+#if defined(__x86_64__)
+__attribute__((constructor))
+static void _select_search_kernel(void) {
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		_search_kernel = _search_avx2;
+	}
+}
+#endif
 
-	str_status_t status = _handle_realloc(self, old_capacity, &new_capacity, new_len);
-	if (status) return status;
+// Returns a pointer to the first occurrence of 'needle' in the first
+// 'haystack_len' bytes of 'haystack' or NULL if there is none.
+static const char *_search(
+	const char *haystack, ulong haystack_len, const char *needle, ulong needle_len
+) {
+	if (!needle_len) return haystack;
+	if (needle_len > haystack_len) return NULL;
+	if (needle_len == 1) return memchr(haystack, needle[0], haystack_len);
+	if (needle_len > SIMD_SEARCH_MAX_NEEDLE) {
+		return _search_scalar(haystack, haystack_len, needle, needle_len);
+	}
+	return _search_kernel(haystack, haystack_len, needle, needle_len);
+}
 
-	strcpy(&self->priv->data[old_len], src);
+static const char *_search_scalar(
+	const char *haystack, ulong haystack_len, const char *needle, ulong needle_len
+) {
+	return memmem(haystack, haystack_len, needle, needle_len);
+}
 
-	self->priv->len = new_len;
-	self->priv->capacity = new_capacity;
+#if defined(__x86_64__)
+// The vector kernels compare a block of the haystack against the first
+// byte of the needle and the block 'needle_len - 1' bytes further against
+// its last byte. Only positions where both match are verified with
+// memcmp(). Whatever is left after the last full block goes to the scalar
+// kernel. 'needle_len' must be at least 2.
+static const char *_search_sse2(
+	const char *haystack, ulong haystack_len, const char *needle, ulong needle_len
+) {
+	const __m128i first = _mm_set1_epi8(needle[0]);
+	const __m128i last = _mm_set1_epi8(needle[needle_len - 1]);
+
+	ulong i = 0;
+	for (; i + needle_len - 1 + 16 <= haystack_len; i += 16) {
+		const __m128i block_first =
+			_mm_loadu_si128((const __m128i*)&haystack[i]);
+		const __m128i block_last =
+			_mm_loadu_si128((const __m128i*)&haystack[i + needle_len - 1]);
+		uint mask = (uint)_mm_movemask_epi8(_mm_and_si128(
+			_mm_cmpeq_epi8(first, block_first),
+			_mm_cmpeq_epi8(last, block_last)
+		));
+		while (mask) {
+			uint bit = (uint)__builtin_ctz(mask);
+			if (!memcmp(&haystack[i + bit + 1], &needle[1], needle_len - 2)) {
+				return &haystack[i + bit];
+			}
+			mask &= mask - 1;
+		}
+	}
 
-	return STR_SUCCESS;
+	return _search_scalar(&haystack[i], haystack_len - i, needle, needle_len);
 }
 
-static str_status_t replace(str_t *self, const char *old_str, const char *new_str) {
-	if (!self || !old_str || !new_str) return STR_NULL_PTR;
-	if (!strlen(old_str)) return STR_EMPTY;
-
-	ulong old_len = self->priv->len;
-	ulong old_capacity = self->priv->capacity;
-	char *data = self->priv->data;
-	ulong num_old_str = 0;
-	for (ulong i = 0; data[i] != '\0'; i++) {
-		if (strstr(&data[i], old_str) == &data[i]) {
-			num_old_str++;
-			i += strlen(old_str) - 1;
+__attribute__((target("avx2")))
+static const char *_search_avx2(
+	const char *haystack, ulong haystack_len, const char *needle, ulong needle_len
+) {
+	const __m256i first = _mm256_set1_epi8(needle[0]);
+	const __m256i last = _mm256_set1_epi8(needle[needle_len - 1]);
+
+	ulong i = 0;
+	for (; i + needle_len - 1 + 32 <= haystack_len; i += 32) {
+		const __m256i block_first =
+			_mm256_loadu_si256((const __m256i*)&haystack[i]);
+		const __m256i block_last =
+			_mm256_loadu_si256((const __m256i*)&haystack[i + needle_len - 1]);
+		uint mask = (uint)_mm256_movemask_epi8(_mm256_and_si256(
+			_mm256_cmpeq_epi8(first, block_first),
+			_mm256_cmpeq_epi8(last, block_last)
+		));
+		while (mask) {
+			uint bit = (uint)__builtin_ctz(mask);
+			if (!memcmp(&haystack[i + bit + 1], &needle[1], needle_len - 2)) {
+				return &haystack[i + bit];
+			}
+			mask &= mask - 1;
 		}
 	}
-	ulong new_len =
-		old_len - (strlen(old_str) * num_old_str) + (strlen(new_str) * num_old_str);
-	ulong new_capacity = old_capacity;
 
-	ulong data_i = 0;
-	ulong result_i = 0;
-	char *result = malloc((new_len + 1) * sizeof(char));
+	return _search_sse2(&haystack[i], haystack_len - i, needle, needle_len);
+}
+#endif
+
+// Precomputes the Horspool pair-shift table for needles longer than
+// SIMD_SEARCH_MAX_NEEDLE.
+static void _pattern_init(str_pattern_t *pattern, const char *needle, ulong len) {
+	pattern->data = needle;
+	pattern->len = len;
+	if (len <= SIMD_SEARCH_MAX_NEEDLE) return;
+
+	// shift[h] is how far the pair ending at the end of the window is from
+	// the last pair with hash h in the needle. The needle's own last pair
+	// gets 0, which marks a candidate.
+	ulong last = len - 1;
+	for (uint h = 0; h < 256; h++) pattern->shift[h] = last;
+	for (ulong i = 1; i < last; i++) {
+		pattern->shift[PAIR_HASH(&needle[i])] = last - i;
+	}
+	uint last_hash = PAIR_HASH(&needle[last]);
+	pattern->shift_on_miss = pattern->shift[last_hash];
+	pattern->shift[last_hash] = 0;
+}
 
-	while (data[data_i] != '\0') {
-		if (strstr(&data[data_i], old_str) == &data[data_i]) {
-			strcpy(&result[result_i], new_str);
-			result_i += strlen(new_str);
-			data_i += strlen(old_str);
-		} else {
-			result[result_i] = data[data_i];
-			result_i++;
-			data_i++;
+// Periodic input can make Horspool verify many candidates that fail late.
+// Every failed candidate is charged the full needle length, and once that
+// adds up to four times the haystack (plus a few free candidates for
+// short haystacks), the rest is left to memmem(), which is linear.
+static const char *_pattern_search(
+	const str_pattern_t *pattern, const char *haystack, ulong haystack_len
+) {
+	ulong len = pattern->len;
+	if (len <= SIMD_SEARCH_MAX_NEEDLE) {
+		return _search(haystack, haystack_len, pattern->data, len);
+	}
+	if (len > haystack_len) return NULL;
+
+	const char *needle = pattern->data;
+	const char *end = haystack + haystack_len;
+	const char *window_end = haystack + len - 1;
+	ulong budget = 4 * haystack_len + 16 * len;
+	while (window_end < end) {
+		ulong shift = pattern->shift[PAIR_HASH(window_end)];
+		if (shift) {
+			window_end += shift;
+			continue;
 		}
+		const char *pos = window_end - (len - 1);
+		if (!memcmp(pos, needle, len)) return pos;
+		if (budget < len) return memmem(pos + 1, (ulong)(end - pos - 1), needle, len);
+		budget -= len;
+		window_end += pattern->shift_on_miss;
+	}
+
+	return NULL;
+}
+
+// Copies 'src' into 'dest' with every occurrence of the needle of 'old'
+// replaced by 'new_str' and returns the number of bytes written. 'dest'
+// may overlap 'src' as long as it does not start after it and the result
+// fits in front of the unread part of the source.
+static ulong _replace_into(
+	char *dest, const char *src, ulong src_len,
+	const str_pattern_t *old, const char *new_str, ulong new_str_len
+) {
+	ulong old_str_len = old->len;
+	const char *end = src + src_len;
+	char *out = dest;
+	const char *match = _pattern_search(old, src, src_len);
+	while (match) {
+		ulong chunk = (ulong)(match - src);
+		memmove(out, src, chunk);
+		out += chunk;
+		memcpy(out, new_str, new_str_len);
+		out += new_str_len;
+		STATS_ADD(bytes_copied, chunk + new_str_len);
+		src = match + old_str_len;
+		match = _pattern_search(old, src, (ulong)(end - src));
+	}
+	memmove(out, src, (ulong)(end - src));
+	STATS_ADD(bytes_copied, (ulong)(end - src));
+	out += end - src;
+
+	return (ulong)(out - dest);
+}
+
+// Appends 'num_parts' parts with 'sep' between them if it is not NULL.
+// The lengths are taken from 'lens' or, if it is NULL, from the null
+// terminators. The total is computed first so the buffer grows at most once.
+static str_status_t _append_parts(
+	str_t *str, const char *sep, const char **parts, const ulong *lens, ulong num_parts
+) {
+	ulong sep_len = sep ? strlen(sep) : 0;
+	ulong total = num_parts ? sep_len * (num_parts - 1) : 0;
+	for (ulong i = 0; i < num_parts; i++) {
+		if (!parts[i]) return STR_NULL_PTR;
+		total += lens ? lens[i] : strlen(parts[i]);
 	}
+	str_status_t status = _mutate(str, true);
+	if (status || !total) return status;
 
-	result[result_i] = '\0';
+	ulong old_len = str->len;
+	ulong old_capacity = str->capacity;
+	ulong new_len = old_len + total;
+	ulong new_capacity = old_capacity;
 
-	str_status_t status = _handle_realloc(self, old_capacity, &new_capacity, new_len);
+	// Any part may point into the string itself, in which case it has to
+	// be located again after the buffer has moved. Only the old content is
+	// read from such parts, as the rest is overwritten while appending.
+	uintptr_t old_data = (uintptr_t)str->data;
+	status = _handle_realloc(str, old_capacity, &new_capacity, new_len);
 	if (status) return status;
-	data = self->priv->data;
+	char *data = str->data;
+
+	char *out = &data[old_len];
+	for (ulong i = 0; i < num_parts; i++) {
+		if (i && sep_len) {
+			uintptr_t addr = (uintptr_t)sep;
+			bool is_inside = addr >= old_data && addr < old_data + old_capacity;
+			memcpy(out, is_inside ? &data[addr - old_data] : sep, sep_len);
+			out += sep_len;
+		}
 
-	strcpy(data, result);
+		uintptr_t addr = (uintptr_t)parts[i];
+		bool is_inside = addr >= old_data && addr < old_data + old_capacity;
+		const char *part = is_inside ? &data[addr - old_data] : parts[i];
+		ulong part_len = 0;
+		if (lens) {
+			part_len = lens[i];
+		} else if (is_inside) {
+			ulong offset = addr - old_data;
+			part_len = strnlen(part, offset < old_len ? old_len - offset : 0);
+		} else {
+			// Copies up to and including the terminator in a single pass.
+			char *end = memccpy(out, part, '\0', new_len - (ulong)(out - data) + 1);
+			STATS_ADD(bytes_copied, (ulong)(end - out) - 1);
+			out = end - 1;
+			continue;
+		}
+		memcpy(out, part, part_len);
+		STATS_ADD(bytes_copied, part_len);
+		out += part_len;
+	}
+	data[new_len] = '\0';
 
-	self->priv->len = new_len;
-	self->priv->capacity = new_capacity;
+	str->len = new_len;
+	str->capacity = new_capacity;
 
-	free(result);
 	return STR_SUCCESS;
 }
 
-static str_status_t data(const str_t *self, const char **dest) {
-	if (!self) return STR_NULL_PTR;
+// Writes the decimal digits of 'value' so that they end right before 'end'
+// and returns their number. Converts two digits per division.
+static ulong _format_uint(char *end, ulong value) {
+	char *out = end;
+	while (value >= 100) {
+		ulong pair = (value % 100) * 2;
+		value /= 100;
+		*--out = _digit_pairs[pair + 1];
+		*--out = _digit_pairs[pair];
+	}
+	if (value >= 10) {
+		*--out = _digit_pairs[value * 2 + 1];
+		*--out = _digit_pairs[value * 2];
+	} else {
+		*--out = (char)('0' + value);
+	}
 
-	*dest = self->priv->data;
+	return (ulong)(end - out);
+}
 
-	return STR_SUCCESS;
+// Called by every operation that changes the content. Refuses to touch
+// immutable strings, drops the cached hash and makes sure the buffer is
+// not shared. Operations that discard the content pass false as
+// 'keep_content', so a shared buffer is given up instead of copied.
+static str_status_t _mutate(str_t *str, bool keep_content) {
+	if (str->is_immutable) return STR_IMMUTABLE;
+	str->has_hash = false;
+
+	if (str->shared && !keep_content) {
+		_drop_buffer(str);
+		str->data = str->small;
+		str->data[0] = '\0';
+		str->len = 0;
+		str->capacity = DEFAULT_CAPACITY;
+	}
+
+	return _unshare(str);
 }
 
-static str_status_t len(const str_t *self, ulong *len) {
-	if (!self) return STR_NULL_PTR;
+// Gives 'str' a buffer of its own. The content is only copied if a clone
+// still uses the buffer.
+static str_status_t _unshare(str_t *str) {
+	if (!str->shared) return STR_SUCCESS;
+
+	if (atomic_load_explicit(&str->shared->refs, memory_order_acquire) == 1) {
+		_mem_free(str, str->shared, sizeof(struct shared));
+		str->shared = NULL;
+		return STR_SUCCESS;
+	}
+
+	char *data = (char*)_mem_alloc(str, str->capacity * sizeof(char));
+	if (!data) return STR_ALLOC_ERROR;
+	memcpy(data, str->data, (str->len + 1) * sizeof(char));
+	STATS_ADD(bytes_copied, str->len + 1);
 
-	*len = self->priv->len;
+	_drop_buffer(str);
+	str->data = data;
 
 	return STR_SUCCESS;
 }
 
-static str_status_t capacity(const str_t *self, ulong *capacity) {
-	if (!self) return STR_NULL_PTR;
+// Lets go of the heap buffer of 'str', which is freed unless clones still
+// use it. Leaves 'data' dangling.
+static void _drop_buffer(str_t *str) {
+	if (_is_small(str)) return;
+
+	if (!str->shared) {
+		_mem_free(str, str->data, str->capacity * sizeof(char));
+		return;
+	}
+
+	struct shared *shared = str->shared;
+	str->shared = NULL;
+	if (atomic_fetch_sub_explicit(&shared->refs, 1, memory_order_acq_rel) == 1) {
+		_mem_free(str, str->data, str->capacity * sizeof(char));
+		_mem_free(str, shared, sizeof(struct shared));
+	}
+}
+
+// Hashing
+// wyhash (final version 4) with a zero seed. Reads the input in 8 byte
+// words and mixes with 64x64->128 bit multiplications.
+static const uint64_t _wyp[4] = {
+	0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull,
+	0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull
+};
+
+static inline uint64_t _wymix(uint64_t a, uint64_t b) {
+	__uint128_t r = (__uint128_t)a * b;
+	return (uint64_t)r ^ (uint64_t)(r >> 64);
+}
+
+static inline uint64_t _wyr8(const char *p) {
+	uint64_t v;
+	memcpy(&v, p, 8);
+	return v;
+}
+
+static inline uint64_t _wyr4(const char *p) {
+	uint32_t v;
+	memcpy(&v, p, 4);
+	return v;
+}
+
+static inline uint64_t _wyr3(const char *p, ulong k) {
+	return ((uint64_t)(unsigned char)p[0] << 16) |
+		((uint64_t)(unsigned char)p[k >> 1] << 8) |
+		(uint64_t)(unsigned char)p[k - 1];
+}
+
+static ulong _hash(const char *data, ulong len) {
+	const char *p = data;
+	uint64_t seed = _wymix(_wyp[0], _wyp[1]);
+	uint64_t a = 0;
+	uint64_t b = 0;
+
+	if (len <= 16) {
+		if (len >= 4) {
+			a = (_wyr4(p) << 32) | _wyr4(p + ((len >> 3) << 2));
+			b = (_wyr4(p + len - 4) << 32) | _wyr4(p + len - 4 - ((len >> 3) << 2));
+		} else if (len > 0) {
+			a = _wyr3(p, len);
+		}
+	} else {
+		ulong i = len;
+		if (i > 48) {
+			uint64_t see1 = seed;
+			uint64_t see2 = seed;
+			do {
+				seed = _wymix(_wyr8(p) ^ _wyp[1], _wyr8(p + 8) ^ seed);
+				see1 = _wymix(_wyr8(p + 16) ^ _wyp[2], _wyr8(p + 24) ^ see1);
+				see2 = _wymix(_wyr8(p + 32) ^ _wyp[3], _wyr8(p + 40) ^ see2);
+				p += 48;
+				i -= 48;
+			} while (i > 48);
+			seed ^= see1 ^ see2;
+		}
+		while (i > 16) {
+			seed = _wymix(_wyr8(p) ^ _wyp[1], _wyr8(p + 8) ^ seed);
+			p += 16;
+			i -= 16;
+		}
+		a = _wyr8(p + i - 16);
+		b = _wyr8(p + i - 8);
+	}
+
+	__uint128_t r = (__uint128_t)(a ^ _wyp[1]) * (b ^ seed);
+	a = (uint64_t)r;
+	b = (uint64_t)(r >> 64);
+
+	return _wymix(a ^ _wyp[0] ^ len, b ^ _wyp[1]);
+}
+
+// Returns the end of the first match in [data, end) and sets 'pattern' to
+// the longest pattern that ends there, or returns NULL. The automaton starts
+// from its root, so a match never overlaps the previous one.
+static const char *_matcher_next(
+	const str_matcher_t *matcher, const char *data, const char *end, ulong *pattern
+) {
+	const uint32_t *next = matcher->next;
+	const unsigned char *byte_class = matcher->byte_class;
+	uint32_t row = 0;
+	while (data < end) {
+		if (!row) {
+			if (matcher->only_start >= 0) {
+				data = memchr(data, matcher->only_start, (ulong)(end - data));
+				if (!data) return NULL;
+			} else {
+				while (data < end && !matcher->is_start[(unsigned char)*data]) data++;
+				if (data == end) return NULL;
+			}
+		}
+		uint32_t entry = next[row + byte_class[(unsigned char)*data++]];
+		row = entry & ~MATCH_FLAG;
+		if (entry & MATCH_FLAG) {
+			*pattern = (ulong)matcher->pattern[row / matcher->num_classes];
+			return data;
+		}
+	}
 
-	*capacity = self->priv->capacity;
+	return NULL;
+}
+
+// Writes 'len' bytes to 'fd', continuing after short writes and signals.
+static str_status_t _write_all(int fd, const char *data, ulong len) {
+	while (len) {
+		ssize_t written = write(fd, data, len);
+		if (written < 0) {
+			if (errno == EINTR) continue;
+			return STR_IO_ERROR;
+		}
+		data += written;
+		len -= (ulong)written;
+	}
 
 	return STR_SUCCESS;
 }
 
-static str_status_t push(str_t *self, char c) {
-	if (!self) return STR_NULL_PTR;
+static void _split_init(const str_t *str, str_split_mode_t mode, str_split_t *split) {
+	memset(split, 0, sizeof(str_split_t));
+	split->data = str->data;
+	split->len = str->len;
+	split->mode = mode;
+}
 
-	ulong old_len = self->priv->len;
-	ulong new_len = old_len + 1;
-	ulong old_capacity = self->priv->capacity;
-	ulong new_capacity = old_capacity;
+// Returns a pointer to the first delimiter in the 'len' bytes at 'from'
+// or NULL if there is none.
+static const char *_split_find(const str_split_t *split, const char *from, ulong len) {
+	switch (split->mode) {
+	case STR_SPLIT_BYTE:
+		return memchr(from, split->delim, len);
+	case STR_SPLIT_BYTE_SET:
+		for (ulong i = 0; i < len; i++) {
+			unsigned char c = (unsigned char)from[i];
+			if (split->set[c >> 3] & (1u << (c & 7))) return &from[i];
+		}
+		return NULL;
+	case STR_SPLIT_SEPARATOR:
+		return _search(from, len, split->sep, split->sep_len);
+	}
+	return NULL;
+}
+
+// Associated functions
+str_status_t str_append_fn(str_t *self, const char *src) {
+	if (!self || !src) return STR_NULL_PTR;
+
+	return str_append_n_fn(self, src, strlen(src));
+}
+
+str_status_t str_append_many_fn(str_t *self, const char **parts, ulong num_parts) {
+	if (!self || (!parts && num_parts)) return STR_NULL_PTR;
+	STATS_ADD(calls.append, 1);
+
+	return _append_parts(self, NULL, parts, NULL, num_parts);
+}
+
+str_status_t str_append_many_n_fn(
+	str_t *self, const char **parts, const ulong *lens, ulong num_parts
+) {
+	if (!self || ((!parts || !lens) && num_parts)) return STR_NULL_PTR;
+	STATS_ADD(calls.append, 1);
+
+	return _append_parts(self, NULL, parts, lens, num_parts);
+}
+
+str_status_t str_join_fn(str_t *self, const char *sep, const char **parts, ulong num_parts) {
+	if (!self || !sep || (!parts && num_parts)) return STR_NULL_PTR;
+	STATS_ADD(calls.append, 1);
+
+	return _append_parts(self, sep, parts, NULL, num_parts);
+}
+
+str_status_t str_appendf_fn(str_t *self, const char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	str_status_t status = str_vappendf_fn(self, fmt, args);
+	va_end(args);
+
+	return status;
+}
 
-	str_status_t status = _handle_realloc(self, old_capacity, &new_capacity, new_len);
+str_status_t str_vappendf_fn(str_t *self, const char *fmt, va_list args) {
+	if (!self || !fmt) return STR_NULL_PTR;
+	str_status_t status = _mutate(self, true);
 	if (status) return status;
+	STATS_ADD(calls.append, 1);
+
+	va_list retry;
+	va_copy(retry, args);
+
+	// The spare capacity always includes room for the terminator.
+	ulong old_len = self->len;
+	ulong spare = self->capacity - old_len;
+	int written = vsnprintf(&self->data[old_len], spare, fmt, args);
+	if (written < 0) {
+		va_end(retry);
+		self->data[old_len] = '\0';
+		return STR_INVALID_ARG;
+	}
 
-	self->priv->data[old_len] = c;
-	self->priv->data[new_len] = '\0';
+	ulong new_len = old_len + (ulong)written;
+	if ((ulong)written >= spare) {
+		ulong old_capacity = self->capacity;
+		ulong new_capacity = old_capacity;
+		status = _handle_realloc(self, old_capacity, &new_capacity, new_len);
+		if (status) {
+			va_end(retry);
+			self->data[old_len] = '\0';
+			return status;
+		}
+		self->capacity = new_capacity;
+		vsnprintf(&self->data[old_len], new_capacity - old_len, fmt, retry);
+	}
+	va_end(retry);
+	STATS_ADD(bytes_copied, (ulong)written);
 
-	self->priv->len = new_len;
-	self->priv->capacity = new_capacity;
+	self->len = new_len;
 
 	return STR_SUCCESS;
 }
 
-static str_status_t pop(str_t *self, char *c) {
+str_status_t str_append_int_fn(str_t *self, long value) {
 	if (!self) return STR_NULL_PTR;
-	if (!self->priv->len) return STR_EMPTY;
 
-	ulong old_len = self->priv->len;
-	ulong new_len = old_len - 1;
-	ulong old_capacity = self->priv->capacity;
-	ulong new_capacity = old_capacity;
+	char buf[24];
+	char *end = &buf[sizeof(buf)];
+	// Negating in unsigned arithmetic keeps LONG_MIN defined.
+	ulong magnitude = value < 0 ? 0UL - (ulong)value : (ulong)value;
+	ulong len = _format_uint(end, magnitude);
+	if (value < 0) end[-(long)++len] = '-';
 
-	*c = self->priv->data[new_len];
-	self->priv->data[new_len] = '\0';
+	return str_append_n_fn(self, end - len, len);
+}
 
-	str_status_t status = _handle_realloc(self, old_capacity, &new_capacity, new_len);
-	if (status) return status;
+str_status_t str_append_uint_fn(str_t *self, ulong value) {
+	if (!self) return STR_NULL_PTR;
 
-	self->priv->len = new_len;
-	self->priv->capacity = new_capacity;
+	char buf[24];
+	char *end = &buf[sizeof(buf)];
+	ulong len = _format_uint(end, value);
 
-	return STR_SUCCESS;
+	return str_append_n_fn(self, end - len, len);
+}
+
+str_status_t str_append_hex_fn(str_t *self, ulong value) {
+	if (!self) return STR_NULL_PTR;
+
+	static const char digits[] = "0123456789abcdef";
+	char buf[2 * sizeof(ulong)];
+	char *end = &buf[sizeof(buf)];
+	char *out = end;
+	do {
+		*--out = digits[value & 0xf];
+		value >>= 4;
+	} while (value);
+
+	return str_append_n_fn(self, out, (ulong)(end - out));
 }
 
-static str_status_t clear(str_t *self) {
+str_status_t str_append_double_fn(str_t *self, double value) {
 	if (!self) return STR_NULL_PTR;
 
+	// 17 significant digits always read back as the same double. Most
+	// values need fewer, so the lowest precision from 15 up that
+	// round-trips wins. Below 15 digits is not tried.
+	char buf[32];
+	int len = 0;
+	for (int precision = 15; precision <= 17; precision++) {
+		len = snprintf(buf, sizeof(buf), "%.*g", precision, value);
+		if (value != value || strtod(buf, NULL) == value) break;
+	}
+	if (len < 0) return STR_INVALID_ARG;
+
+	return str_append_n_fn(self, buf, (ulong)len);
+}
+
+str_status_t str_replace_fn(str_t *self, const char *old_str, const char *new_str) {
+	if (!self || !old_str || !new_str) return STR_NULL_PTR;
+
+	ulong old_str_len = strlen(old_str);
+	if (!old_str_len) return STR_EMPTY;
+	str_pattern_t old;
+	_pattern_init(&old, old_str, old_str_len);
+
+	return _replace(self, &old, new_str, strlen(new_str));
+}
+
+static str_status_t _replace(
+	str_t *self, const str_pattern_t *old, const char *new_str, ulong new_str_len
+) {
+	ulong old_str_len = old->len;
+	str_status_t status = _mutate(self, true);
+	if (status) return status;
+	STATS_ADD(calls.replace, 1);
+
+	ulong old_len = self->len;
+	ulong old_capacity = self->capacity;
+	ulong new_capacity = old_capacity;
 	ulong new_len = 0;
-	ulong old_capacity = self->priv->capacity;
-	ulong new_capacity = DEFAULT_CAPACITY;
+	char *data = self->data;
+
+	// Both passes overwrite the buffer while they are still searching it,
+	// and the buffer may move before the second one, so needles that point
+	// into the string itself are copied out first.
+	bool is_old_inside = old->data >= data && old->data < data + old_capacity;
+	bool is_new_inside = new_str >= data && new_str < data + old_capacity;
+	str_pattern_t old_copy;
+	char *scratch = NULL;
+	ulong scratch_size = 0;
+	if (is_old_inside || is_new_inside) {
+		scratch_size = (is_old_inside ? old_str_len : 0) + (is_new_inside ? new_str_len : 0);
+		scratch = _mem_alloc(self, scratch_size);
+		if (!scratch) return STR_ALLOC_ERROR;
+		char *out = scratch;
+		if (is_old_inside) {
+			memcpy(out, old->data, old_str_len);
+			old_copy = *old;
+			old_copy.data = out;
+			old = &old_copy;
+			out += old_str_len;
+		}
+		if (is_new_inside) {
+			memcpy(out, new_str, new_str_len);
+			new_str = out;
+		}
+	}
 
-	memset(self->priv->data, 0, old_capacity * sizeof(char));
+	if (new_str_len <= old_str_len) {
+		// The result is never longer than the source so it can be written
+		// over it in a single pass.
+		new_len = _replace_into(data, data, old_len, old, new_str, new_str_len);
+		data[new_len] = '\0';
+		if (scratch) _mem_free(self, scratch, scratch_size);
 
-	if (old_capacity != new_capacity) {
-		char *tmp = (char*)realloc(self->priv->data, new_capacity);
-		if (!tmp) return STR_REALLOC_ERROR;
-		self->priv->data = tmp;
+		status = _handle_realloc(self, old_capacity, &new_capacity, new_len);
+		if (status) return status;
+
+		self->len = new_len;
+		self->capacity = new_capacity;
+
+		return STR_SUCCESS;
+	}
+
+	ulong num_matches = 0;
+	const char *end = data + old_len;
+	const char *match = _pattern_search(old, data, old_len);
+	while (match) {
+		num_matches++;
+		match += old_str_len;
+		match = _pattern_search(old, match, (ulong)(end - match));
 	}
+	if (!num_matches) {
+		if (scratch) _mem_free(self, scratch, scratch_size);
+		return STR_SUCCESS;
+	}
+
+	new_len = old_len + (new_str_len - old_str_len) * num_matches;
+	status = _handle_realloc(self, old_capacity, &new_capacity, new_len);
+	if (status) {
+		if (scratch) _mem_free(self, scratch, scratch_size);
+		return status;
+	}
+	data = self->data;
+
+	// Move the source to the end of the buffer and write the result
+	// from the front. The write position can never overtake the read
+	// position, so no scratch buffer is needed.
+	ulong shift = new_len - old_len;
+	memmove(&data[shift], data, old_len);
+	STATS_ADD(bytes_copied, old_len);
+	_replace_into(data, &data[shift], old_len, old, new_str, new_str_len);
+	data[new_len] = '\0';
+	if (scratch) _mem_free(self, scratch, scratch_size);
 
-	self->priv->len = new_len;
-	self->priv->capacity = new_capacity;
+	self->len = new_len;
+	self->capacity = new_capacity;
 
 	return STR_SUCCESS;
 }
 
-static str_status_t cmp(const str_t *self, const char *pattern, bool *is_same) {
-	if (!self || !pattern) return STR_NULL_PTR;
+str_status_t str_data_fn(const str_t *self, const char **dest) {
+	if (!self) return STR_NULL_PTR;
 
-	if (strcmp(self->priv->data, pattern) == 0) {
-		*is_same = true;
-	} else {
-		*is_same = false;
-	}
+	*dest = self->data;
 
 	return STR_SUCCESS;
 }
 
-static str_status_t has(const str_t *self, const char *pattern, bool *has) {
-	if (!self || !pattern) return STR_NULL_PTR;
+str_status_t str_len_fn(const str_t *self, ulong *len) {
+	if (!self) return STR_NULL_PTR;
 
-	if (strstr(self->priv->data, pattern)) {
-		*has = true;
-	} else {
-		*has = false;
-	}
+	*len = self->len;
 
 	return STR_SUCCESS;
 }
+
+str_status_t str_capacity_fn(const str_t *self, ulong *capacity) {
+	if (!self) return STR_NULL_PTR;
+
+	*capacity = self->capacity;
+
+	return STR_SUCCESS;
+}
+
+str_status_t str_push_fn(str_t *self, char c) {
+	if (!self) return STR_NULL_PTR;
+	str_status_t status = _mutate(self, true);
+	if (status) return status;
+	STATS_ADD(calls.push, 1);
+
+	ulong old_len = self->len;
+	ulong new_len = old_len + 1;
+	ulong old_capacity = self->capacity;
+	ulong new_capacity = old_capacity;
+
+	status = _handle_realloc(self, old_capacity, &new_capacity, new_len);
+	if (status) return status;
+
+	self->data[old_len] = c;
+	self->data[new_len] = '\0';
+
+	self->len = new_len;
+	self->capacity = new_capacity;
+
+	return STR_SUCCESS;
+}
+
+str_status_t str_pop_fn(str_t *self, char *c) {
+	if (!self) return STR_NULL_PTR;
+	if (!self->len) return STR_EMPTY;
+	str_status_t status = _mutate(self, true);
+	if (status) return status;
+	STATS_ADD(calls.pop, 1);
+
+	ulong old_len = self->len;
+	ulong new_len = old_len - 1;
+	ulong old_capacity = self->capacity;
+	ulong new_capacity = old_capacity;
+
+	*c = self->data[new_len];
+	self->data[new_len] = '\0';
+
+	status = _handle_realloc(self, old_capacity, &new_capacity, new_len);
+	if (status) return status;
+
+	self->len = new_len;
+	self->capacity = new_capacity;
+
+	return STR_SUCCESS;
+}
+
+str_status_t str_clear_fn(str_t *self) {
+	if (!self) return STR_NULL_PTR;
+	str_status_t status = _mutate(self, false);
+	if (status) return status;
+	STATS_ADD(calls.clear, 1);
+
+	self->data[0] = '\0';
+	self->len = 0;
+
+	return STR_SUCCESS;
+}
+
+str_status_t str_cmp_fn(const str_t *self, const char *pattern, bool *is_same) {
+	if (!self || !pattern) return STR_NULL_PTR;
+
+	return str_equals_n_fn(self, pattern, strlen(pattern), is_same);
+}
+
+str_status_t str_has_fn(const str_t *self, const char *pattern, bool *has) {
+	if (!self || !pattern) return STR_NULL_PTR;
+
+	return str_has_n_fn(self, pattern, strlen(pattern), has);
+}
+
+str_status_t str_find_fn(const str_t *self, const char *pattern, ulong *pos) {
+	return str_find_from_fn(self, pattern, 0, pos);
+}
+
+str_status_t str_find_from_fn(
+	const str_t *self, const char *pattern, ulong from, ulong *pos
+) {
+	if (!self || !pattern) return STR_NULL_PTR;
+
+	*pos = STR_NPOS;
+	STATS_ADD(calls.search, 1);
+	if (from > self->len) return STR_SUCCESS;
+
+	const char *data = self->data;
+	const char *match =
+		_search(&data[from], self->len - from, pattern, strlen(pattern));
+	if (match) *pos = (ulong)(match - data);
+
+	return STR_SUCCESS;
+}
+
+str_status_t str_append_n_fn(str_t *self, const char *src, ulong src_len) {
+	if (!self || !src) return STR_NULL_PTR;
+	str_status_t status = _mutate(self, true);
+	if (status) return status;
+	STATS_ADD(calls.append, 1);
+
+	ulong old_len = self->len;
+	ulong old_capacity = self->capacity;
+	ulong new_len = old_len + src_len;
+	ulong new_capacity = old_capacity;
+
+	// 'src' may point into the string itself, in which case it has to be
+	// located again after the buffer has moved.
+	const char *data = self->data;
+	bool is_inside = src >= data && src < data + old_capacity;
+	ulong offset = is_inside ? (ulong)(src - data) : 0;
+
+	status = _handle_realloc(self, old_capacity, &new_capacity, new_len);
+	if (status) return status;
+	if (is_inside) src = &self->data[offset];
+
+	memcpy(&self->data[old_len], src, src_len);
+	STATS_ADD(bytes_copied, src_len);
+	self->data[new_len] = '\0';
+
+	self->len = new_len;
+	self->capacity = new_capacity;
+
+	return STR_SUCCESS;
+}
+
+str_status_t str_append_str_fn(str_t *self, const str_t *src) {
+	if (!self || !src) return STR_NULL_PTR;
+
+	return str_append_n_fn(self, src->data, src->len);
+}
+
+str_status_t str_equals_n_fn(
+	const str_t *self, const char *pattern, ulong pattern_len, bool *is_same
+) {
+	if (!self || !pattern) return STR_NULL_PTR;
+	STATS_ADD(calls.compare, 1);
+
+	*is_same = self->len == pattern_len &&
+		!memcmp(self->data, pattern, pattern_len);
+
+	return STR_SUCCESS;
+}
+
+str_status_t str_has_n_fn(
+	const str_t *self, const char *pattern, ulong pattern_len, bool *has
+) {
+	if (!self || !pattern) return STR_NULL_PTR;
+	STATS_ADD(calls.search, 1);
+
+	*has = _search(self->data, self->len, pattern, pattern_len) != NULL;
+
+	return STR_SUCCESS;
+}
+
+str_status_t str_reserve_fn(str_t *self, ulong len) {
+	if (!self) return STR_NULL_PTR;
+	STATS_ADD(calls.reserve, 1);
+
+	// The terminator has to fit as well.
+	if (len >= ULONG_MAX) return STR_INVALID_ARG;
+	ulong old_capacity = self->capacity;
+	if (len < old_capacity) return STR_SUCCESS;
+
+	str_status_t status = _unshare(self);
+	if (status) return status;
+	status = _set_capacity(self, old_capacity, len + 1);
+	if (status) return status;
+
+	self->capacity = len + 1;
+
+	return STR_SUCCESS;
+}
+
+str_status_t str_shrink_to_fit_fn(str_t *self) {
+	if (!self) return STR_NULL_PTR;
+	STATS_ADD(calls.shrink_to_fit, 1);
+
+	ulong old_capacity = self->capacity;
+	ulong new_capacity = self->len + 1;
+	if (new_capacity < DEFAULT_CAPACITY) new_capacity = DEFAULT_CAPACITY;
+	if (new_capacity == old_capacity) return STR_SUCCESS;
+
+	str_status_t status = _unshare(self);
+	if (status) return status;
+	status = _set_capacity(self, old_capacity, new_capacity);
+	if (status) return status;
+
+	self->capacity = new_capacity;
+
+	return STR_SUCCESS;
+}
+
+str_status_t str_set_policy_fn(str_t *self, const str_policy_t *policy) {
+	if (!self || !policy) return STR_NULL_PTR;
+	if (!_is_valid_policy(policy)) return STR_INVALID_ARG;
+
+	self->policy = *policy;
+
+	return STR_SUCCESS;
+}
+
+str_status_t str_release_fn(str_t *self) {
+	if (!self) return STR_NULL_PTR;
+	str_status_t status = _mutate(self, false);
+	if (status) return status;
+	STATS_ADD(calls.release, 1);
+
+	_drop_buffer(self);
+	self->data = self->small;
+
+	self->data[0] = '\0';
+	self->len = 0;
+	self->capacity = DEFAULT_CAPACITY;
+
+	return STR_SUCCESS;
+}
+
+
+// Views
+str_status_t str_view_fn(const str_t *self, ulong pos, ulong len, str_view_t *view) {
+	if (!self || !view) return STR_NULL_PTR;
+	if (pos > self->len) return STR_OUT_OF_RANGE;
+
+	ulong available = self->len - pos;
+	view->data = &self->data[pos];
+	view->len = len < available ? len : available;
+
+	return STR_SUCCESS;
+}
+
+str_status_t str_append_view_fn(str_t *self, str_view_t view) {
+	if (!self || !view.data) return STR_NULL_PTR;
+
+	return str_append_n_fn(self, view.data, view.len);
+}
+
+str_status_t str_cmp_view_fn(const str_t *self, str_view_t view, bool *is_same) {
+	if (!self || !view.data) return STR_NULL_PTR;
+
+	return str_equals_n_fn(self, view.data, view.len, is_same);
+}
+
+str_status_t str_has_view_fn(const str_t *self, str_view_t view, bool *has) {
+	if (!self || !view.data) return STR_NULL_PTR;
+
+	return str_has_n_fn(self, view.data, view.len, has);
+}
+
+// Splitting
+str_status_t str_split_fn(const str_t *self, char delim, str_split_t *split) {
+	if (!self || !split) return STR_NULL_PTR;
+
+	_split_init(self, STR_SPLIT_BYTE, split);
+	split->delim = delim;
+
+	return STR_SUCCESS;
+}
+
+str_status_t str_split_any_fn(const str_t *self, const char *delims, str_split_t *split) {
+	if (!self || !delims || !split) return STR_NULL_PTR;
+
+	_split_init(self, STR_SPLIT_BYTE_SET, split);
+	for (const char *d = delims; *d; d++) {
+		unsigned char c = (unsigned char)*d;
+		split->set[c >> 3] |= (unsigned char)(1u << (c & 7));
+	}
+
+	return STR_SUCCESS;
+}
+
+str_status_t str_split_sep_fn(const str_t *self, const char *sep, str_split_t *split) {
+	if (!self || !sep || !split) return STR_NULL_PTR;
+	if (!*sep) return STR_EMPTY;
+
+	_split_init(self, STR_SPLIT_SEPARATOR, split);
+	split->sep = sep;
+	split->sep_len = strlen(sep);
+
+	return STR_SUCCESS;
+}
+
+str_status_t str_split_next_fn(str_split_t *split, str_view_t *token, bool *has_token) {
+	if (!split || !token || !has_token) return STR_NULL_PTR;
+
+	*has_token = !split->done;
+	if (split->done) return STR_SUCCESS;
+
+	const char *start = &split->data[split->pos];
+	ulong remaining = split->len - split->pos;
+	const char *delim = _split_find(split, start, remaining);
+
+	token->data = start;
+	if (delim) {
+		token->len = (ulong)(delim - start);
+		split->pos += token->len +
+			(split->mode == STR_SPLIT_SEPARATOR ? split->sep_len : 1);
+	} else {
+		token->len = remaining;
+		split->pos = split->len;
+		split->done = true;
+	}
+
+	return STR_SUCCESS;
+}
+
+str_status_t str_split_into_fn(
+	str_split_t *split, str_view_t *tokens, ulong max_tokens, ulong *num_tokens
+) {
+	if (!split || !tokens || !num_tokens) return STR_NULL_PTR;
+
+	ulong count = 0;
+	bool has_token = true;
+	while (count < max_tokens) {
+		str_status_t status = str_split_next_fn(split, &tokens[count], &has_token);
+		if (status) return status;
+		if (!has_token) break;
+		count++;
+	}
+	*num_tokens = count;
+
+	return STR_SUCCESS;
+}
+
+// Hashing and immutability
+str_status_t str_hash_fn(const str_t *self, ulong *hash) {
+	if (!self || !hash) return STR_NULL_PTR;
+
+	if (!self->has_hash) {
+		// Strings are never defined const, only the cache is written.
+		str_t *cache = (str_t*)self;
+		cache->hash = _hash(self->data, self->len);
+		cache->has_hash = true;
+	}
+	*hash = self->hash;
+
+	return STR_SUCCESS;
+}
+
+ulong str_hash_n(const char *data, ulong len) {
+	return _hash(data, len);
+}
+
+str_status_t str_freeze_fn(str_t *self) {
+	if (!self) return STR_NULL_PTR;
+
+	self->is_immutable = true;
+
+	return STR_SUCCESS;
+}
+
+str_status_t str_is_frozen_fn(const str_t *self, bool *is_frozen) {
+	if (!self || !is_frozen) return STR_NULL_PTR;
+
+	*is_frozen = self->is_immutable;
+
+	return STR_SUCCESS;
+}
+
+// Ownership transfer
+str_status_t str_detach_fn(str_t *self, char **buf, ulong *len, ulong *capacity) {
+	if (!self || !buf) return STR_NULL_PTR;
+	str_status_t status = _mutate(self, true);
+	if (status) return status;
+
+	ulong buf_capacity = self->capacity;
+	if (_is_small(self)) {
+		// The inline buffer can't be handed out, copy it to the heap.
+		buf_capacity = self->len + 1;
+		*buf = (char*)_mem_alloc(self, buf_capacity * sizeof(char));
+		if (!*buf) return STR_ALLOC_ERROR;
+		memcpy(*buf, self->data, buf_capacity * sizeof(char));
+		STATS_ADD(bytes_copied, buf_capacity);
+	} else {
+		*buf = self->data;
+	}
+	if (len) *len = self->len;
+	if (capacity) *capacity = buf_capacity;
+
+	self->data = self->small;
+	self->data[0] = '\0';
+	self->len = 0;
+	self->capacity = DEFAULT_CAPACITY;
+
+	return STR_SUCCESS;
+}
+
+// I/O
+str_status_t str_read_fd_fn(str_t *self, int fd) {
+	if (!self) return STR_NULL_PTR;
+	str_status_t status = _mutate(self, true);
+	if (status) return status;
+	STATS_ADD(calls.append, 1);
+
+	ulong old_len = self->len;
+
+	// The rest of a regular file is read into a buffer sized once. The
+	// extra byte lets the last read() report the end of the file without
+	// growing the buffer.
+	struct stat st;
+	bool is_sized = !fstat(fd, &st) && S_ISREG(st.st_mode);
+	if (is_sized) {
+		off_t offset = lseek(fd, 0, SEEK_CUR);
+		if (offset < 0) offset = 0;
+		ulong remaining = st.st_size > offset ? (ulong)(st.st_size - offset) : 0;
+		status = str_reserve_fn(self, old_len + remaining + 1);
+		if (status) return status;
+	}
+
+	while (true) {
+		ulong spare = self->capacity - self->len - 1;
+		if (!spare || (!is_sized && spare < READ_CHUNK)) {
+			ulong old_capacity = self->capacity;
+			ulong new_capacity = old_capacity;
+			status = _handle_realloc(
+				self, old_capacity, &new_capacity, self->len + READ_CHUNK
+			);
+			if (status) break;
+			self->capacity = new_capacity;
+			spare = new_capacity - self->len - 1;
+		}
+
+		ssize_t num_read = read(fd, &self->data[self->len], spare);
+		if (num_read < 0) {
+			if (errno == EINTR) continue;
+			status = STR_IO_ERROR;
+			break;
+		}
+		if (!num_read) break;
+		self->len += (ulong)num_read;
+		STATS_ADD(bytes_copied, (ulong)num_read);
+	}
+
+	// Nothing is appended if reading fails half way.
+	if (status) self->len = old_len;
+	self->data[self->len] = '\0';
+
+	return status;
+}
+
+str_status_t str_read_file_fn(str_t *self, const char *path) {
+	if (!self || !path) return STR_NULL_PTR;
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) return STR_IO_ERROR;
+
+	str_status_t status = str_read_fd_fn(self, fd);
+	close(fd);
+
+	return status;
+}
+
+str_status_t str_write_fd_fn(const str_t *self, int fd) {
+	if (!self) return STR_NULL_PTR;
+
+	return _write_all(fd, self->data, self->len);
+}
+
+str_status_t str_writev_fd_fn(int fd, const str_t **strs, ulong num_strs) {
+	if (!strs && num_strs) return STR_NULL_PTR;
+
+	struct iovec iov[WRITEV_BATCH];
+	for (ulong first = 0; first < num_strs; first += WRITEV_BATCH) {
+		int count = 0;
+		for (ulong i = first; i < num_strs && i < first + WRITEV_BATCH; i++) {
+			if (!strs[i]) return STR_NULL_PTR;
+			iov[count].iov_base = strs[i]->data;
+			iov[count].iov_len = strs[i]->len;
+			count++;
+		}
+
+		// After a short write the fully written entries are skipped and
+		// the first partially written one is advanced.
+		struct iovec *next = iov;
+		while (true) {
+			while (count && !next->iov_len) {
+				next++;
+				count--;
+			}
+			if (!count) break;
+
+			ssize_t written = writev(fd, next, count);
+			if (written < 0) {
+				if (errno == EINTR) continue;
+				return STR_IO_ERROR;
+			}
+			ulong left = (ulong)written;
+			while (left && left >= next->iov_len) {
+				left -= next->iov_len;
+				next++;
+				count--;
+			}
+			if (left) {
+				next->iov_base = (char*)next->iov_base + left;
+				next->iov_len -= left;
+			}
+		}
+	}
+
+	return STR_SUCCESS;
+}
+
+// Multi-pattern matching
+str_status_t create_str_matcher(
+	str_matcher_t **matcher, const char **patterns, ulong num_patterns
+) {
+	if (!matcher || !patterns) return STR_NULL_PTR;
+	if (*matcher) return STR_NOT_EMPTY;
+	if (!num_patterns) return STR_INVALID_ARG;
+
+	ulong max_states = 1;
+	bool is_used[256] = {0};
+	for (ulong i = 0; i < num_patterns; i++) {
+		if (!patterns[i]) return STR_NULL_PTR;
+		if (!patterns[i][0]) return STR_INVALID_ARG;
+		for (const char *c = patterns[i]; *c; c++) {
+			is_used[(unsigned char)*c] = true;
+			max_states++;
+		}
+	}
+
+	str_matcher_t *m = calloc(1, sizeof(str_matcher_t));
+	if (!m) return STR_ALLOC_ERROR;
+
+	// Every byte that occurs in a pattern gets a class of its own, the
+	// rest share the last one.
+	for (uint b = 0; b < 256; b++) {
+		if (is_used[b]) m->byte_class[b] = (unsigned char)m->num_classes++;
+	}
+	if (m->num_classes < 256) {
+		for (uint b = 0; b < 256; b++) {
+			if (!is_used[b]) m->byte_class[b] = (unsigned char)m->num_classes;
+		}
+		m->num_classes++;
+	}
+	ulong nc = m->num_classes;
+
+	if (max_states > MATCH_MAX_ENTRIES / nc) {
+		free(m);
+		return STR_INVALID_ARG;
+	}
+	m->next = calloc(max_states * nc, sizeof(uint32_t));
+	m->pattern = malloc(max_states * sizeof(long));
+	m->pattern_lens = malloc(num_patterns * sizeof(ulong));
+	ulong *fail = malloc(max_states * sizeof(ulong));
+	ulong *queue = malloc(max_states * sizeof(ulong));
+	if (!m->next || !m->pattern || !m->pattern_lens || !fail || !queue) {
+		free(fail);
+		free(queue);
+		str_matcher_destroy(&m);
+		return STR_ALLOC_ERROR;
+	}
+	m->num_patterns = num_patterns;
+
+	// Build the trie. While building, a zero entry means no edge, as no
+	// edge leads back to the root.
+	m->num_states = 1;
+	m->pattern[0] = -1;
+	for (ulong i = 0; i < num_patterns; i++) {
+		ulong state = 0;
+		const char *c = patterns[i];
+		for (; *c; c++) {
+			uint32_t *edge = &m->next[state * nc + m->byte_class[(unsigned char)*c]];
+			if (!*edge) {
+				m->pattern[m->num_states] = -1;
+				*edge = (uint32_t)m->num_states++;
+			}
+			state = *edge;
+		}
+		m->pattern_lens[i] = (ulong)(c - patterns[i]);
+		// The first of several equal patterns wins.
+		if (m->pattern[state] < 0) m->pattern[state] = (long)i;
+	}
+
+	// Breadth first, fill in the missing edges of every state from its
+	// failure state, whose row is already complete. A state without a
+	// pattern of its own reports the longest one of its failure state,
+	// which is the longest pattern that is a suffix of it.
+	ulong head = 0;
+	ulong tail = 0;
+	for (ulong c = 0; c < nc; c++) {
+		uint32_t child = m->next[c];
+		if (child) {
+			fail[child] = 0;
+			queue[tail++] = child;
+		}
+	}
+	while (head < tail) {
+		ulong state = queue[head++];
+		for (ulong c = 0; c < nc; c++) {
+			uint32_t *edge = &m->next[state * nc + c];
+			uint32_t fallback = m->next[fail[state] * nc + c];
+			if (*edge) {
+				fail[*edge] = fallback;
+				if (m->pattern[*edge] < 0) m->pattern[*edge] = m->pattern[fallback];
+				queue[tail++] = *edge;
+			} else {
+				*edge = fallback;
+			}
+		}
+	}
+	free(fail);
+	free(queue);
+
+	m->only_start = -1;
+	ulong num_starts = 0;
+	for (uint b = 0; b < 256; b++) {
+		m->is_start[b] = m->next[m->byte_class[b]] != 0;
+		if (m->is_start[b]) {
+			m->only_start = (int)b;
+			num_starts++;
+		}
+	}
+	if (num_starts > 1) m->only_start = -1;
+
+	// Turn states into row offsets and flag the ones that end a pattern.
+	for (ulong i = 0; i < m->num_states * nc; i++) {
+		uint32_t target = m->next[i];
+		m->next[i] = (uint32_t)(target * nc) | (m->pattern[target] >= 0 ? MATCH_FLAG : 0);
+	}
+
+	*matcher = m;
+
+	return STR_SUCCESS;
+}
+
+void str_matcher_destroy(str_matcher_t **matcher) {
+	if (matcher && *matcher) {
+		free((*matcher)->next);
+		free((*matcher)->pattern);
+		free((*matcher)->pattern_lens);
+		free(*matcher);
+		*matcher = NULL;
+	}
+}
+
+str_status_t str_has_any_fn(const str_t *self, const str_matcher_t *matcher, bool *has) {
+	if (!self || !matcher || !has) return STR_NULL_PTR;
+
+	ulong pattern;
+	*has = _matcher_next(matcher, self->data, self->data + self->len, &pattern) != NULL;
+
+	return STR_SUCCESS;
+}
+
+str_status_t str_find_all_fn(
+	const str_t *self, const str_matcher_t *matcher,
+	str_match_t *matches, ulong max_matches, ulong *num_matches
+) {
+	if (!self || !matcher || !num_matches) return STR_NULL_PTR;
+	if (!matches && max_matches) return STR_NULL_PTR;
+
+	const char *end = self->data + self->len;
+	const char *match_end = self->data;
+	ulong pattern;
+	ulong count = 0;
+	while ((match_end = _matcher_next(matcher, match_end, end, &pattern))) {
+		if (count < max_matches) {
+			ulong len = matcher->pattern_lens[pattern];
+			matches[count].pos = (ulong)(match_end - self->data) - len;
+			matches[count].len = len;
+			matches[count].pattern = pattern;
+		}
+		count++;
+	}
+	*num_matches = count;
+
+	return STR_SUCCESS;
+}
+
+str_status_t str_replace_all_map_fn(
+	str_t *self, const str_matcher_t *matcher, const char **replacements
+) {
+	if (!self || !matcher || !replacements) return STR_NULL_PTR;
+	for (ulong i = 0; i < matcher->num_patterns; i++) {
+		if (!replacements[i]) return STR_NULL_PTR;
+	}
+	str_status_t status = _mutate(self, true);
+	if (status) return status;
+	STATS_ADD(calls.replace, 1);
+
+	// The replacement lengths are measured once, and replacements that
+	// point into the string itself are copied out, because the buffer is
+	// overwritten and may move before they are read.
+	ulong num_patterns = matcher->num_patterns;
+	const char *data = self->data;
+	ulong capacity = self->capacity;
+	ulong scratch_size = num_patterns * (sizeof(ulong) + sizeof(char *));
+	for (ulong i = 0; i < num_patterns; i++) {
+		if (replacements[i] >= data && replacements[i] < data + capacity) {
+			scratch_size += strlen(replacements[i]);
+		}
+	}
+	char *scratch = _mem_alloc(self, scratch_size);
+	if (!scratch) return STR_ALLOC_ERROR;
+	ulong *lens = (ulong *)scratch;
+	const char **rebased = (const char **)(lens + num_patterns);
+	char *copy = (char *)(rebased + num_patterns);
+	for (ulong i = 0; i < num_patterns; i++) {
+		lens[i] = strlen(replacements[i]);
+		rebased[i] = replacements[i];
+		if (replacements[i] >= data && replacements[i] < data + capacity) {
+			memcpy(copy, replacements[i], lens[i]);
+			rebased[i] = copy;
+			copy += lens[i];
+		}
+	}
+
+	status = _replace_all_map(self, matcher, rebased, lens);
+	_mem_free(self, scratch, scratch_size);
+
+	return status;
+}
+
+static str_status_t _replace_all_map(
+	str_t *self, const str_matcher_t *matcher, const char **replacements, const ulong *lens
+) {
+	// First pass: the length of the result, and how far the output ever
+	// runs ahead of the input.
+	ulong old_len = self->len;
+	const char *end = self->data + old_len;
+	const char *match_end = self->data;
+	ulong pattern;
+	ulong num_matches = 0;
+	long delta = 0;
+	long lead = 0;
+	while ((match_end = _matcher_next(matcher, match_end, end, &pattern))) {
+		delta += (long)lens[pattern] - (long)matcher->pattern_lens[pattern];
+		if (delta > lead) lead = delta;
+		num_matches++;
+	}
+	if (!num_matches) return STR_SUCCESS;
+
+	// Second pass: the source is moved 'lead' bytes towards the end of
+	// the buffer, then the result is written from the front. The write
+	// position never overtakes the read position, so only the buffer
+	// itself is needed.
+	ulong new_len = (ulong)((long)old_len + delta);
+	ulong old_capacity = self->capacity;
+	ulong new_capacity = old_capacity;
+	str_status_t status;
+	if ((ulong)lead) {
+		status = _handle_realloc(self, old_capacity, &new_capacity, old_len + (ulong)lead);
+		if (status) return status;
+		self->capacity = new_capacity;
+		memmove(&self->data[lead], self->data, old_len);
+		STATS_ADD(bytes_copied, old_len);
+	}
+
+	char *dest = self->data;
+	const char *src = &self->data[lead];
+	end = src + old_len;
+	match_end = src;
+	while ((match_end = _matcher_next(matcher, match_end, end, &pattern))) {
+		const char *match = match_end - matcher->pattern_lens[pattern];
+		ulong literal_len = (ulong)(match - src);
+		memmove(dest, src, literal_len);
+		dest += literal_len;
+		memcpy(dest, replacements[pattern], lens[pattern]);
+		dest += lens[pattern];
+		src = match_end;
+	}
+	memmove(dest, src, (ulong)(end - src));
+	self->data[new_len] = '\0';
+	STATS_ADD(bytes_copied, new_len);
+
+	// Gives memory back if the result is much shorter.
+	new_capacity = self->capacity;
+	status = _handle_realloc(self, self->capacity, &new_capacity, new_len);
+	if (status) return status;
+	self->len = new_len;
+	self->capacity = new_capacity;
+
+	return STR_SUCCESS;
+}
+
+// Precompiled patterns
+str_status_t create_str_pattern(str_pattern_t **pattern, const char *needle) {
+	if (!pattern || !needle) return STR_NULL_PTR;
+	if (*pattern) return STR_NOT_EMPTY;
+
+	ulong len = strlen(needle);
+	if (!len) return STR_EMPTY;
+
+	str_pattern_t *p = malloc(sizeof(str_pattern_t) + len + 1);
+	if (!p) return STR_ALLOC_ERROR;
+	memcpy(p->owned, needle, len + 1);
+	_pattern_init(p, p->owned, len);
+	*pattern = p;
+
+	return STR_SUCCESS;
+}
+
+void str_pattern_destroy(str_pattern_t **pattern) {
+	if (pattern && *pattern) {
+		free(*pattern);
+		*pattern = NULL;
+	}
+}
+
+str_status_t str_has_pattern_fn(const str_t *self, const str_pattern_t *pattern, bool *has) {
+	if (!self || !pattern || !has) return STR_NULL_PTR;
+	STATS_ADD(calls.search, 1);
+
+	*has = _pattern_search(pattern, self->data, self->len) != NULL;
+
+	return STR_SUCCESS;
+}
+
+str_status_t str_count_pattern_fn(
+	const str_t *self, const str_pattern_t *pattern, ulong *count
+) {
+	if (!self || !pattern || !count) return STR_NULL_PTR;
+	STATS_ADD(calls.search, 1);
+
+	const char *end = self->data + self->len;
+	const char *match = _pattern_search(pattern, self->data, self->len);
+	*count = 0;
+	while (match) {
+		(*count)++;
+		match += pattern->len;
+		match = _pattern_search(pattern, match, (ulong)(end - match));
+	}
+
+	return STR_SUCCESS;
+}
+
+str_status_t str_replace_pattern_fn(
+	str_t *self, const str_pattern_t *pattern, const char *new_str
+) {
+	if (!self || !pattern || !new_str) return STR_NULL_PTR;
+
+	return _replace(self, pattern, new_str, strlen(new_str));
+}
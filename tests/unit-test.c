@@ -3,6 +3,10 @@
 #include <sys/types.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
 
 uint completed = 0;
 uint passed = 0;
@@ -220,11 +224,33 @@ int test_clear() {
 	"capacity. Fingers crossed!";
 
 	str_auto str = str_new(original_text);
+	ulong capacity = str_capacity(str);
+	const char *buffer = str_data(str);
 	str_clear(str);
 	ASSERT(str_len(str) == 0);
-	ASSERT(str_capacity(str) == 16);
+	ASSERT(str_capacity(str) == capacity);
+	ASSERT(str_data(str) == buffer);
 	printf("%s\n", str_data(str));
 	ASSERT(str_cmp(str, "") == true);
+	str_append(str, original_text);
+	ASSERT(str_data(str) == buffer);
+	ASSERT(str_cmp(str, original_text));
+	return 0;
+}
+
+int test_release() {
+	const char *original_text = "This is some super duper long text.\n"
+	"This text is so long, this will surely need to realloc the memory,\n"
+	"because this text is definitely longer than 16 bytes, which is the default\n"
+	"capacity. Fingers crossed!";
+
+	str_auto str = str_new(original_text);
+	str_release(str);
+	ASSERT(str_len(str) == 0);
+	ASSERT(str_capacity(str) == 16);
+	ASSERT(str_cmp(str, ""));
+	str_append(str, original_text);
+	ASSERT(str_cmp(str, original_text));
 	return 0;
 }
 
@@ -267,6 +293,1460 @@ int test_has_empty() {
 	return 0;
 }
 
+int test_small_string() {
+	str_auto str = str_new("short");
+	const char *inline_data = str_data(str);
+	ASSERT(str_capacity(str) == 16);
+
+	str_append(str, " but not for long, this outgrows the inline buffer");
+	ASSERT(str_data(str) != inline_data);
+	ASSERT(str_cmp(str, "short but not for long, this outgrows the inline buffer"));
+
+	while (str_len(str) > 3) {
+		__attribute__((unused)) char c = str_pop(str);
+	}
+	ASSERT(str_capacity(str) == 16);
+	ASSERT(str_data(str) == inline_data);
+	ASSERT(str_cmp(str, "sho"));
+
+	str_append(str, " and long again, back on the heap we go");
+	str_release(str);
+	ASSERT(str_data(str) == inline_data);
+	ASSERT(str_cmp(str, ""));
+	return 0;
+}
+
+int test_replace_adjacent() {
+	str_auto str = str_new("aaaaa");
+	str_replace(str, "aa", "b");
+	ASSERT(str_cmp(str, "bba"));
+	ASSERT(str_len(str) == 3);
+	return 0;
+}
+
+int test_replace_grow_in_place() {
+	str_auto str = str_new("x,y,z,");
+	str_replace(str, ",", ", and then ");
+	ASSERT(str_cmp(str, "x, and then y, and then z, and then "));
+	ASSERT(str_len(str) == strlen("x, and then y, and then z, and then "));
+	return 0;
+}
+
+int test_replace_no_match() {
+	str_auto str = str_new("nothing to see here");
+	str_replace(str, "carrot", "a much longer replacement");
+	ASSERT(str_cmp(str, "nothing to see here"));
+	ASSERT(str_capacity(str) == 32);
+	return 0;
+}
+
+int test_replace_with_itself() {
+	str_auto str = str_new("one:two:three:four");
+	str_replace(str, ":", str_data(str));
+	ASSERT(str_cmp(str,
+		"one" "one:two:three:four" "two" "one:two:three:four"
+		"three" "one:two:three:four" "four"
+	));
+
+	str_auto shrunk = str_new("abc-abc-abc");
+	str_replace(shrunk, str_data(shrunk) + 8, "!");
+	ASSERT(str_cmp(shrunk, "!-!-!"));
+	return 0;
+}
+
+int test_find() {
+	str_auto str = str_new("one, two, three, four");
+	ASSERT(str_find(str, "one") == 0);
+	ASSERT(str_find(str, "three") == 10);
+	ASSERT(str_find(str, "five") == STR_NPOS);
+	ASSERT(str_find(str, "") == 0);
+	return 0;
+}
+
+int test_find_from() {
+	str_auto str = str_new("a-b-c-d");
+	ulong count = 0;
+	ulong pos = str_find(str, "-");
+	while (pos != STR_NPOS) {
+		count++;
+		pos = str_find_from(str, "-", pos + 1);
+	}
+	ASSERT(count == 3);
+	ASSERT(str_find_from(str, "a", 1) == STR_NPOS);
+	ASSERT(str_find_from(str, "d", str_len(str)) == STR_NPOS);
+	ASSERT(str_find_from(str, "d", 100) == STR_NPOS);
+	return 0;
+}
+
+int test_find_long() {
+	// Places the needle at every offset of a haystack long enough to
+	// exercise the vector kernels and their scalar tail.
+	const char *needles[] = {"xy", "xyz", "needle", "a needle that is quite a bit longer than 32 bytes"};
+	for (uint n = 0; n < sizeof(needles) / sizeof(char*); n++) {
+		for (ulong offset = 0; offset < 100; offset++) {
+			str_auto str = str_new();
+			for (ulong i = 0; i < offset; i++) str_push(str, 'x');
+			str_append(str, needles[n]);
+			for (ulong i = 0; i < 40; i++) str_push(str, 'x');
+			if (str_find(str, needles[n]) != offset) return -1;
+			if (!str_has(str, needles[n])) return -1;
+			if (str_find_from(str, needles[n], offset + 1) != STR_NPOS) return -1;
+		}
+	}
+	return 0;
+}
+
+int test_append_n() {
+	str_auto str = str_new("key");
+	str_append_n(str, "=value;ignored", 6);
+	ASSERT(str_cmp(str, "key=value"));
+	ASSERT(str_len(str) == 9);
+	return 0;
+}
+
+int test_embedded_null() {
+	str_auto str = str_new();
+	str_append_n(str, "a\0b", 3);
+	str_push(str, '\0');
+	str_append(str, "c");
+	ASSERT(str_len(str) == 5);
+	ASSERT(str_equals_n(str, "a\0b\0c", 5));
+	ASSERT(!str_equals_n(str, "a\0b\0d", 5));
+	ASSERT(!str_cmp(str, "a"));
+	ASSERT(str_has_n(str, "b\0c", 3));
+	ASSERT(!str_has_n(str, "b\0d", 3));
+	ASSERT(str_pop(str) == 'c');
+	ASSERT(str_pop(str) == '\0');
+	ASSERT(str_len(str) == 3);
+	return 0;
+}
+
+int test_append_str() {
+	str_auto str = str_new("abc");
+	str_auto other = str_new("-def");
+	str_append_str(str, other);
+	ASSERT(str_cmp(str, "abc-def"));
+	str_append_str(str, str);
+	ASSERT(str_cmp(str, "abc-defabc-def"));
+	str_append_str(str, str);
+	ASSERT(str_cmp(str, "abc-defabc-defabc-defabc-def"));
+	return 0;
+}
+
+int test_reserve() {
+	str_auto str = str_new("abc");
+	str_reserve(str, 1000);
+	ASSERT(str_capacity(str) == 1001);
+	const char *reserved = str_data(str);
+	for (uint i = 0; i < 997; i++) str_push(str, 'x');
+	ASSERT(str_len(str) == 1000);
+	ASSERT(str_capacity(str) == 1001);
+	ASSERT(str_data(str) == reserved);
+	str_reserve(str, 10);
+	ASSERT(str_capacity(str) == 1001);
+	ASSERT(str_reserve_fn(str, ULONG_MAX) == STR_INVALID_ARG);
+	ASSERT(str_capacity(str) == 1001);
+	return 0;
+}
+
+int test_shrink_to_fit() {
+	str_auto str = str_new("some text that lives on the heap");
+	str_reserve(str, 4096);
+	str_shrink_to_fit(str);
+	ASSERT(str_capacity(str) == str_len(str) + 1);
+	ASSERT(str_cmp(str, "some text that lives on the heap"));
+
+	str_auto small = str_new("tiny");
+	const char *inline_data = str_data(small);
+	str_reserve(small, 100);
+	str_shrink_to_fit(small);
+	ASSERT(str_capacity(small) == 16);
+	ASSERT(str_data(small) == inline_data);
+	ASSERT(str_cmp(small, "tiny"));
+	return 0;
+}
+
+int test_policy_never_shrink() {
+	str_auto str = str_new();
+	str_policy_t policy = {.growth_percent = 200, .shrink = STR_SHRINK_NEVER};
+	str_set_policy(str, &policy);
+	for (uint i = 0; i < 100; i++) str_push(str, 'x');
+	ASSERT(str_capacity(str) == 128);
+	while (str_len(str)) {
+		__attribute__((unused)) char c = str_pop(str);
+	}
+	ASSERT(str_capacity(str) == 128);
+	str_shrink_to_fit(str);
+	ASSERT(str_capacity(str) == 16);
+	return 0;
+}
+
+int test_policy_hysteresis() {
+	str_auto str = str_new();
+	for (uint i = 0; i < 33; i++) str_push(str, 'x');
+	ASSERT(str_capacity(str) == 64);
+	// Oscillating around the 32 byte boundary keeps the capacity.
+	for (uint i = 0; i < 10; i++) {
+		__attribute__((unused)) char a = str_pop(str);
+		__attribute__((unused)) char b = str_pop(str);
+		str_push(str, 'x');
+		str_push(str, 'x');
+	}
+	ASSERT(str_capacity(str) == 64);
+	while (str_len(str) > 15) {
+		__attribute__((unused)) char c = str_pop(str);
+	}
+	ASSERT(str_capacity(str) == 32);
+	return 0;
+}
+
+int test_policy_growth() {
+	str_auto str = str_new();
+	str_policy_t policy = {.growth_percent = 150, .shrink = STR_SHRINK_EAGER};
+	str_set_policy(str, &policy);
+	str_append(str, "0123456789abcdef");
+	ASSERT(str_capacity(str) == 24);
+	str_append(str, "0123456789");
+	ASSERT(str_capacity(str) == 36);
+	return 0;
+}
+
+int test_policy_invalid() {
+	str_auto str = str_new();
+	str_policy_t policy = {.growth_percent = 100, .shrink = STR_SHRINK_NEVER};
+	ASSERT(str_set_policy_fn(str, &policy) == STR_INVALID_ARG);
+	ASSERT(str_set_default_policy(&policy) == STR_INVALID_ARG);
+	return 0;
+}
+
+int test_default_policy() {
+	str_policy_t policy = {.growth_percent = 150, .shrink = STR_SHRINK_NEVER};
+	ASSERT(str_set_default_policy(&policy) == STR_SUCCESS);
+	str_auto str = str_new("0123456789abcdef");
+	ASSERT(str_capacity(str) == 24);
+	policy.growth_percent = 200;
+	policy.shrink = STR_SHRINK_HYSTERESIS;
+	ASSERT(str_set_default_policy(&policy) == STR_SUCCESS);
+	return 0;
+}
+
+// Allocator that counts outstanding blocks and bytes.
+typedef struct counting_ctx {
+	long blocks;
+	long bytes;
+	long reallocs;
+} counting_ctx_t;
+
+void *counting_alloc(void *ctx, size_t size) {
+	counting_ctx_t *counts = ctx;
+	counts->blocks++;
+	counts->bytes += (long)size;
+	return malloc(size);
+}
+
+void *counting_realloc(void *ctx, void *ptr, size_t old_size, size_t new_size) {
+	counting_ctx_t *counts = ctx;
+	counts->reallocs++;
+	counts->bytes += (long)new_size - (long)old_size;
+	return realloc(ptr, new_size);
+}
+
+void counting_free(void *ctx, void *ptr, size_t size) {
+	counting_ctx_t *counts = ctx;
+	counts->blocks--;
+	counts->bytes -= (long)size;
+	free(ptr);
+}
+
+int test_custom_allocator() {
+	counting_ctx_t counts = {0};
+	str_allocator_t allocator = {
+		.alloc = counting_alloc,
+		.realloc = counting_realloc,
+		.free = counting_free,
+		.ctx = &counts
+	};
+
+	str_t *str = NULL;
+	TRY(create_str_with_allocator(&str, &allocator));
+	ASSERT(counts.blocks == 1);
+	TRY(str_append_fn(str, "a string long enough to move to the heap"));
+	ASSERT(counts.blocks == 2);
+	TRY(str_replace_fn(str, "heap", "heap, and then some more to grow it"));
+	TRY(str_append_fn(str, " and even more text to grow it again, and again and again"));
+	TRY(str_release_fn(str));
+	ASSERT(counts.blocks == 1);
+	TRY(str_append_fn(str, "and back on the heap"));
+	str_destroy(&str);
+	ASSERT(counts.blocks == 0);
+	ASSERT(counts.bytes == 0);
+	return 0;
+}
+
+int test_arena() {
+	str_arena_t *arena = NULL;
+	TRY(create_str_arena(&arena, 4096));
+	ASSERT(create_str_arena(&arena, 4096) == STR_NOT_EMPTY);
+
+	str_t *strs[100] = {0};
+	for (uint i = 0; i < 100; i++) {
+		TRY(create_str_with_allocator(&strs[i], str_arena_allocator(arena)));
+		TRY(str_append_fn(strs[i], "request scoped string number "));
+		for (uint j = 0; j < i; j++) TRY(str_push_fn(strs[i], 'x'));
+	}
+	bool is_same = false;
+	TRY(str_cmp_fn(strs[42], "request scoped string number "
+		"xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx", &is_same));
+	ASSERT(is_same);
+	str_destroy(&strs[99]);
+	ASSERT(strs[99] == NULL);
+
+	str_arena_reset(arena);
+	str_t *str = NULL;
+	TRY(create_str_with_allocator(&str, str_arena_allocator(arena)));
+	TRY(str_append_fn(str, "reused memory"));
+	TRY(str_cmp_fn(str, "reused memory", &is_same));
+	ASSERT(is_same);
+
+	str_arena_destroy(&arena);
+	ASSERT(arena == NULL);
+	return 0;
+}
+
+int test_arena_large_allocation() {
+	str_arena_t *arena = NULL;
+	TRY(create_str_arena(&arena, 64));
+	str_t *str = NULL;
+	TRY(create_str_with_allocator(&str, str_arena_allocator(arena)));
+	for (uint i = 0; i < 10000; i++) TRY(str_push_fn(str, (char)('a' + i % 26)));
+	ulong len = 0;
+	TRY(str_len_fn(str, &len));
+	ASSERT(len == 10000);
+	const char *data = NULL;
+	TRY(str_data_fn(str, &data));
+	ASSERT(data[9999] == (char)('a' + 9999 % 26));
+
+	// Resetting after the large allocation leaves a working arena.
+	str_arena_reset(arena);
+	str_t *strs[8] = {0};
+	bool all_ok = true;
+	for (uint i = 0; i < 8; i++) {
+		TRY(create_str_with_allocator(&strs[i], str_arena_allocator(arena)));
+		TRY(str_append_fn(strs[i], "reused after a reset"));
+		bool is_same = false;
+		TRY(str_cmp_fn(strs[i], "reused after a reset", &is_same));
+		all_ok = all_ok && is_same;
+	}
+	ASSERT(all_ok);
+	str = NULL;
+	TRY(create_str_with_allocator(&str, str_arena_allocator(arena)));
+	for (uint i = 0; i < 10000; i++) TRY(str_push_fn(str, 'z'));
+	TRY(str_len_fn(str, &len));
+	ASSERT(len == 10000);
+	str_arena_reset(arena);
+	str_arena_destroy(&arena);
+	return 0;
+}
+
+int test_view() {
+	str_auto str = str_new("Host: example.com");
+	str_view_t name = str_view(str, 0, 4);
+	ASSERT(name.len == 4);
+	ASSERT(!memcmp(name.data, "Host", 4));
+	str_view_t value = str_view(str, 6, STR_NPOS);
+	ASSERT(value.len == 11);
+	ASSERT(value.data == str_data(str) + 6);
+	str_view_t end = str_view(str, str_len(str), 10);
+	ASSERT(end.len == 0);
+	str_view_t view;
+	ASSERT(str_view_fn(str, str_len(str) + 1, 1, &view) == STR_OUT_OF_RANGE);
+	return 0;
+}
+
+int test_view_cmp_has() {
+	str_auto str = str_new("Content-Length: 42");
+	str_auto other = str_new("Length");
+	str_view_t view = str_view(str, 8, 6);
+	ASSERT(str_cmp_view(other, view));
+	ASSERT(str_has_view(str, view));
+	str_view_t digits = str_view(str, 16, 2);
+	ASSERT(!str_cmp_view(other, digits));
+	ASSERT(!str_has_view(other, digits));
+	return 0;
+}
+
+int test_append_view() {
+	str_auto str = str_new("key=value");
+	str_auto dest = str_new();
+	str_append_view(dest, str_view(str, 4, STR_NPOS));
+	ASSERT(str_cmp(dest, "value"));
+	str_append_view(str, str_view(str, 0, 3));
+	ASSERT(str_cmp(str, "key=valuekey"));
+	for (uint i = 0; i < 4; i++) str_append_view(str, str_view(str, 0, STR_NPOS));
+	ASSERT(str_len(str) == 12 * 16);
+	ASSERT(!memcmp(str_data(str) + 180, "key=valuekey", 12));
+	return 0;
+}
+
+int test_split() {
+	str_auto str = str_new("a,bc,,d,");
+	const char *expected[] = {"a", "bc", "", "d", ""};
+	str_split_t split = str_split(str, ',');
+	str_view_t token;
+	uint i = 0;
+	while (str_split_next(&split, &token)) {
+		ASSERT(i < 5);
+		ASSERT(token.len == strlen(expected[i]));
+		ASSERT(!memcmp(token.data, expected[i], token.len));
+		i++;
+	}
+	ASSERT(i == 5);
+	ASSERT(!str_split_next(&split, &token));
+
+	str_auto empty = str_new();
+	split = str_split(empty, ',');
+	ASSERT(str_split_next(&split, &token));
+	ASSERT(token.len == 0);
+	ASSERT(!str_split_next(&split, &token));
+	return 0;
+}
+
+int test_split_any() {
+	str_auto str = str_new("GET /index.html\tHTTP/1.1");
+	str_split_t split = str_split_any(str, " \t");
+	str_view_t tokens[4];
+	ASSERT(str_split_into(&split, tokens, 4) == 3);
+	ASSERT(tokens[0].len == 3 && !memcmp(tokens[0].data, "GET", 3));
+	ASSERT(tokens[1].data == str_data(str) + 4);
+	ASSERT(tokens[1].len == 11);
+	ASSERT(tokens[2].len == 8 && !memcmp(tokens[2].data, "HTTP/1.1", 8));
+
+	str_auto high = str_new("a\xff" "b\x80" "c");
+	split = str_split_any(high, "\x80\xff");
+	ASSERT(str_split_into(&split, tokens, 4) == 3);
+	ASSERT(tokens[2].len == 1 && tokens[2].data[0] == 'c');
+	return 0;
+}
+
+int test_split_sep() {
+	str_auto str = str_new("key: value\r\nhost: x\r\n\r\n");
+	str_split_t split = str_split_sep(str, "\r\n");
+	str_view_t tokens[2];
+	ASSERT(str_split_into(&split, tokens, 2) == 2);
+	ASSERT(tokens[0].len == 10);
+	ASSERT(tokens[1].len == 7 && !memcmp(tokens[1].data, "host: x", 7));
+	ASSERT(str_split_into(&split, tokens, 2) == 2);
+	ASSERT(tokens[0].len == 0);
+	ASSERT(tokens[1].len == 0);
+	ASSERT(str_split_into(&split, tokens, 2) == 0);
+	ASSERT(str_split_sep_fn(str, "", &split) == STR_EMPTY);
+	return 0;
+}
+
+int test_append_many() {
+	str_auto str = str_new("GET", " ", "/index.html", " ", "HTTP/1.1");
+	ASSERT(str_cmp(str, "GET /index.html HTTP/1.1"));
+	str_append_many(str, "\r\n", "Host: ", "example.com");
+	ASSERT(str_cmp(str, "GET /index.html HTTP/1.1\r\nHost: example.com"));
+	str_auto empty = str_new();
+	ASSERT(str_len(empty) == 0);
+	const char *parts[] = {"a", NULL};
+	ASSERT(str_append_many_fn(str, parts, 2) == STR_NULL_PTR);
+	return 0;
+}
+
+int test_append_many_grows_once() {
+	counting_ctx_t counts = {0};
+	str_allocator_t allocator = {
+		.alloc = counting_alloc,
+		.realloc = counting_realloc,
+		.free = counting_free,
+		.ctx = &counts
+	};
+	str_t *str = NULL;
+	TRY(create_str_with_allocator(&str, &allocator));
+	TRY(str_append_fn(str, "twenty bytes of text"));
+	const char *parts[] = {
+		"a fairly long piece of text, ",
+		"followed by another fairly long one, ",
+		"and a third that makes the total well over a hundred bytes"
+	};
+	TRY(str_append_many_fn(str, parts, 3));
+	ASSERT(counts.reallocs == 1);
+	ulong len = 0;
+	TRY(str_len_fn(str, &len));
+	ASSERT(len == 20 + strlen(parts[0]) + strlen(parts[1]) + strlen(parts[2]));
+	str_destroy(&str);
+	ASSERT(counts.blocks == 0);
+	return 0;
+}
+
+int test_append_many_n() {
+	str_auto str = str_new();
+	const char *parts[] = {"a\0b", "cd", "e\0"};
+	ulong lens[] = {3, 2, 2};
+	TRY(str_append_many_n_fn(str, parts, lens, 3));
+	ASSERT(str_len(str) == 7);
+	ASSERT(str_equals_n(str, "a\0bcde\0", 7));
+	return 0;
+}
+
+int test_join() {
+	str_auto str = str_new("list: ");
+	str_join(str, ", ", "one", "two", "three");
+	ASSERT(str_cmp(str, "list: one, two, three"));
+	str_auto single = str_new();
+	str_join(single, ", ", "one");
+	ASSERT(str_cmp(single, "one"));
+	str_auto empty_sep = str_new();
+	str_join(empty_sep, "", "a", "b");
+	ASSERT(str_cmp(empty_sep, "ab"));
+	return 0;
+}
+
+int test_append_many_alias() {
+	str_auto str = str_new("abc");
+	const char *self_parts[] = {str_data(str), "-", str_data(str) + 1};
+	TRY(str_append_many_fn(str, self_parts, 3));
+	ASSERT(str_cmp(str, "abcabc-bc"));
+	const char *data = str_data(str);
+	const char *parts[] = {data, data};
+	TRY(str_join_fn(str, data + 6, parts, 2));
+	ASSERT(str_cmp(str, "abcabc-bc" "abcabc-bc" "-bc" "abcabc-bc"));
+	data = str_data(str);
+	parts[0] = data;
+	parts[1] = data;
+	TRY(str_join_fn(str, data + 27, parts, 2));
+	ASSERT(str_len(str) == 93);
+	ASSERT(!memcmp(str_data(str) + 63, str_data(str), 30));
+	return 0;
+}
+
+int test_appendf() {
+	str_auto str = str_new("status: ");
+	str_appendf(str, "%d", 200);
+	ASSERT(str_cmp(str, "status: 200"));
+	str_appendf(str, " %s took %.2f ms (%lu bytes)", "GET /", 1.5, 1024UL);
+	ASSERT(str_cmp(str, "status: 200 GET / took 1.50 ms (1024 bytes)"));
+	str_auto small = str_new("abc");
+	str_appendf(small, "%012d", 42);
+	ASSERT(str_cmp(small, "abc000000000042"));
+	ASSERT(str_capacity(small) == 16);
+	str_appendf(small, "%s", "!");
+	ASSERT(str_cmp(small, "abc000000000042!"));
+	ASSERT(str_capacity(small) == 32);
+	return 0;
+}
+
+int test_append_int() {
+	str_auto str = str_new();
+	str_append_int(str, 0);
+	str_push(str, ' ');
+	str_append_int(str, -7);
+	str_push(str, ' ');
+	str_append_int(str, 1234567890);
+	str_push(str, ' ');
+	str_append_int(str, -9223372036854775807L - 1);
+	str_push(str, ' ');
+	str_append_uint(str, 18446744073709551615UL);
+	str_push(str, ' ');
+	str_append_uint(str, 10);
+	ASSERT(str_cmp(str,
+		"0 -7 1234567890 -9223372036854775808 18446744073709551615 10"));
+	return 0;
+}
+
+int test_append_hex() {
+	str_auto str = str_new();
+	str_append_hex(str, 0);
+	str_push(str, ' ');
+	str_append_hex(str, 0xdeadbeef);
+	str_push(str, ' ');
+	str_append_hex(str, 0xffffffffffffffffUL);
+	ASSERT(str_cmp(str, "0 deadbeef ffffffffffffffff"));
+	return 0;
+}
+
+int test_append_double() {
+	str_auto str = str_new();
+	str_append_double(str, 0.1);
+	str_push(str, ' ');
+	str_append_double(str, -2.5);
+	str_push(str, ' ');
+	str_append_double(str, 1e300);
+	str_push(str, ' ');
+	str_append_double(str, 3.0);
+	ASSERT(str_cmp(str, "0.1 -2.5 1e+300 3"));
+	str_auto third = str_new();
+	str_append_double(third, 1.0 / 3.0);
+	ASSERT(strtod(str_data(third), NULL) == 1.0 / 3.0);
+	return 0;
+}
+
+int test_hash() {
+	str_auto a = str_new("content-type");
+	str_auto b = str_new("content-", "type");
+	ASSERT(str_hash(a) == str_hash(b));
+	ASSERT(str_hash(a) == str_hash_n("content-type", 12));
+	ulong before = str_hash(a);
+	str_push(a, 's');
+	ASSERT(str_hash(a) != before);
+	ASSERT(str_hash(a) == str_hash_n("content-types", 13));
+	str_pop(a);
+	ASSERT(str_hash(a) == before);
+	str_replace(a, "type", "length");
+	ASSERT(str_hash(a) == str_hash_n("content-length", 14));
+	str_clear(a);
+	ASSERT(str_hash(a) == str_hash_n("", 0));
+	ASSERT(str_hash_n("a\0b", 3) != str_hash_n("a\0c", 3));
+	char long_text[200];
+	for (uint i = 0; i < 200; i++) long_text[i] = (char)('a' + i % 26);
+	bool all_match = true;
+	bool all_differ = true;
+	for (ulong len = 1; len < 200; len++) {
+		str_auto str = str_new();
+		str_append_n(str, long_text, len);
+		all_match = all_match && str_hash(str) == str_hash_n(long_text, len);
+		all_differ = all_differ && str_hash(str) != str_hash_n(long_text, len - 1);
+	}
+	ASSERT(all_match);
+	ASSERT(all_differ);
+	return 0;
+}
+
+int test_freeze() {
+	str_auto str = str_new("constant");
+	str_freeze(str);
+	bool is_frozen = false;
+	TRY(str_is_frozen_fn(str, &is_frozen));
+	ASSERT(is_frozen);
+	ASSERT(str_append_fn(str, "x") == STR_IMMUTABLE);
+	ASSERT(str_push_fn(str, 'x') == STR_IMMUTABLE);
+	char c;
+	ASSERT(str_pop_fn(str, &c) == STR_IMMUTABLE);
+	ASSERT(str_replace_fn(str, "con", "in") == STR_IMMUTABLE);
+	ASSERT(str_clear_fn(str) == STR_IMMUTABLE);
+	ASSERT(str_release_fn(str) == STR_IMMUTABLE);
+	ASSERT(str_appendf_fn(str, "%d", 1) == STR_IMMUTABLE);
+	const char *parts[] = {"x"};
+	ASSERT(str_append_many_fn(str, parts, 1) == STR_IMMUTABLE);
+	ASSERT(str_cmp(str, "constant"));
+	return 0;
+}
+
+int test_intern() {
+	str_intern_t *intern = NULL;
+	TRY(create_str_intern(&intern));
+	ASSERT(create_str_intern(&intern) == STR_NOT_EMPTY);
+
+	const str_t *a = str_intern(intern, "accept");
+	const str_t *b = str_intern(intern, "accept");
+	const str_t *c = str_intern(intern, "accept-encoding");
+	ASSERT(a == b);
+	ASSERT(a != c);
+	ASSERT(str_cmp(a, "accept"));
+	bool is_frozen = false;
+	TRY(str_is_frozen_fn(a, &is_frozen));
+	ASSERT(is_frozen);
+
+	str_auto key = str_new("accept");
+	const str_t *d = NULL;
+	TRY(str_intern_str_fn(intern, key, &d));
+	ASSERT(d == a);
+	const str_t *e = NULL;
+	TRY(str_intern_n_fn(intern, "accept\0", 7, &e));
+	ASSERT(e != a);
+
+	ulong count = 0;
+	TRY(str_intern_count_fn(intern, &count));
+	ASSERT(count == 3);
+
+	str_intern_destroy(&intern);
+	ASSERT(intern == NULL);
+	return 0;
+}
+
+int test_intern_grow() {
+	str_intern_t *intern = NULL;
+	TRY(create_str_intern(&intern));
+	const str_t *first[1000];
+	for (uint i = 0; i < 1000; i++) {
+		str_auto key = str_new("key-");
+		str_append_uint(key, i);
+		TRY(str_intern_str_fn(intern, key, &first[i]));
+	}
+	bool all_same = true;
+	for (uint i = 0; i < 1000; i++) {
+		str_auto key = str_new("key-");
+		str_append_uint(key, i);
+		const str_t *again = NULL;
+		TRY(str_intern_str_fn(intern, key, &again));
+		all_same = all_same && again == first[i];
+	}
+	ASSERT(all_same);
+	ulong count = 0;
+	TRY(str_intern_count_fn(intern, &count));
+	ASSERT(count == 1000);
+	str_intern_destroy(&intern);
+	return 0;
+}
+
+#define INTERN_THREADS 8
+#define INTERN_KEYS 2000
+
+typedef struct intern_job {
+	str_intern_t *intern;
+	uint offset;
+	const str_t *interned[INTERN_KEYS];
+	int status;
+} intern_job_t;
+
+void *intern_keys(void *arg) {
+	intern_job_t *job = arg;
+	// Every thread walks the keys from a different starting point so
+	// inserts and lookups of the same key race.
+	for (uint i = 0; i < INTERN_KEYS; i++) {
+		uint key = (i + job->offset) % INTERN_KEYS;
+		char buf[32];
+		int len = snprintf(buf, sizeof(buf), "route-%u", key);
+		job->status = str_intern_n_fn(
+			job->intern, buf, (ulong)len, &job->interned[key]
+		);
+		if (job->status) break;
+	}
+	return NULL;
+}
+
+int test_intern_threads() {
+	str_intern_t *intern = NULL;
+	TRY(create_str_intern(&intern));
+	static intern_job_t jobs[INTERN_THREADS];
+	pthread_t threads[INTERN_THREADS];
+	for (uint i = 0; i < INTERN_THREADS; i++) {
+		jobs[i].intern = intern;
+		jobs[i].offset = i * INTERN_KEYS / INTERN_THREADS;
+		jobs[i].status = 0;
+		ASSERT(pthread_create(&threads[i], NULL, intern_keys, &jobs[i]) == 0);
+	}
+	for (uint i = 0; i < INTERN_THREADS; i++) pthread_join(threads[i], NULL);
+
+	bool all_ok = true;
+	for (uint i = 0; i < INTERN_THREADS; i++) {
+		all_ok = all_ok && jobs[i].status == 0;
+		for (uint j = 0; j < INTERN_KEYS; j++) {
+			all_ok = all_ok && jobs[i].interned[j] == jobs[0].interned[j];
+		}
+	}
+	ASSERT(all_ok);
+	ulong count = 0;
+	TRY(str_intern_count_fn(intern, &count));
+	ASSERT(count == INTERN_KEYS);
+	ASSERT(str_cmp(jobs[3].interned[1234], "route-1234"));
+	str_intern_destroy(&intern);
+	return 0;
+}
+
+int test_clone_small() {
+	str_auto str = str_new("short");
+	str_auto clone = str_clone(str);
+	ASSERT(str_cmp(clone, "short"));
+	ASSERT(str_data(clone) != str_data(str));
+	str_push(clone, '!');
+	ASSERT(str_cmp(str, "short"));
+	ASSERT(str_cmp(clone, "short!"));
+	str_t *not_empty = clone;
+	ASSERT(str_clone_fn(str, &not_empty) == STR_NOT_EMPTY);
+	return 0;
+}
+
+int test_clone_shared() {
+	str_auto str = str_new("a payload that is fanned out to many consumers");
+	str_auto a = str_clone(str);
+	str_auto b = str_clone(a);
+	ASSERT(str_data(a) == str_data(str));
+	ASSERT(str_data(b) == str_data(str));
+	ASSERT(str_cmp(b, "a payload that is fanned out to many consumers"));
+	ASSERT(str_capacity(b) == str_capacity(str));
+
+	str_replace(a, "many", "several");
+	ASSERT(str_data(a) != str_data(str));
+	ASSERT(str_cmp(a, "a payload that is fanned out to several consumers"));
+	ASSERT(str_cmp(str, "a payload that is fanned out to many consumers"));
+	ASSERT(str_data(b) == str_data(str));
+
+	const char *shared = str_data(str);
+	str_append(str, "!");
+	ASSERT(str_data(str) != shared);
+	ASSERT(str_data(b) == shared);
+	// The last owner modifies the buffer in place.
+	str_append(b, "?");
+	ASSERT(str_data(b) == shared);
+	ASSERT(str_cmp(b, "a payload that is fanned out to many consumers?"));
+	ASSERT(str_cmp(str, "a payload that is fanned out to many consumers!"));
+	return 0;
+}
+
+int test_clone_clear() {
+	str_auto str = str_new();
+	for (uint i = 0; i < 100; i++) str_push(str, 'x');
+	str_auto clone = str_clone(str);
+	str_clear(clone);
+	ASSERT(str_len(clone) == 0);
+	ASSERT(str_capacity(clone) == 16);
+	ASSERT(str_len(str) == 100);
+	str_auto other = str_clone(str);
+	str_release(str);
+	ASSERT(str_len(other) == 100);
+	ASSERT(str_data(other)[99] == 'x');
+	str_reserve(other, 1000);
+	str_auto last = str_clone(other);
+	str_shrink_to_fit(last);
+	ASSERT(str_capacity(last) == 101);
+	ASSERT(str_capacity(other) == 1001);
+	ASSERT(str_equals_n(last, str_data(other), 100));
+	return 0;
+}
+
+void *append_to_clone(void *arg) {
+	str_t *str = arg;
+	for (uint i = 0; i < 100; i++) {
+		if (str_push_fn(str, 'y')) break;
+	}
+	return NULL;
+}
+
+int test_clone_threads() {
+	str_auto str = str_new();
+	for (uint i = 0; i < 1000; i++) str_push(str, 'x');
+	str_t *clones[INTERN_THREADS] = {0};
+	pthread_t threads[INTERN_THREADS];
+	for (uint i = 0; i < INTERN_THREADS; i++) {
+		TRY(str_clone_fn(str, &clones[i]));
+	}
+	for (uint i = 0; i < INTERN_THREADS; i++) {
+		ASSERT(pthread_create(&threads[i], NULL, append_to_clone, clones[i]) == 0);
+	}
+	for (uint i = 0; i < INTERN_THREADS; i++) pthread_join(threads[i], NULL);
+	bool all_ok = true;
+	for (uint i = 0; i < INTERN_THREADS; i++) {
+		ulong len = 0;
+		TRY(str_len_fn(clones[i], &len));
+		all_ok = all_ok && len == 1100;
+		str_destroy(&clones[i]);
+	}
+	ASSERT(all_ok);
+	ASSERT(str_len(str) == 1000);
+	return 0;
+}
+
+int test_from_owned() {
+	char *buf = malloc(64);
+	memcpy(buf, "read from a socket", 18);
+	str_auto str = str_from_owned(buf, 18, 64);
+	ASSERT(str_data(str) == buf);
+	ASSERT(str_cmp(str, "read from a socket"));
+	ASSERT(str_capacity(str) == 64);
+	str_append(str, ", then appended to");
+	ASSERT(str_data(str) == buf);
+	ASSERT(str_cmp(str, "read from a socket, then appended to"));
+
+	char *tiny = malloc(4);
+	memcpy(tiny, "abc", 3);
+	str_auto grown = str_from_owned(tiny, 3, 4);
+	str_append(grown, "defghijklmnopqrstuvwxyz");
+	ASSERT(str_cmp(grown, "abcdefghijklmnopqrstuvwxyz"));
+
+	// Buffers smaller than the inline one are copied into it, so growing
+	// through and shrinking back to 16 bytes never reads past 'small'.
+	char *small = malloc(8);
+	memcpy(small, "abc", 3);
+	str_auto pushed = str_from_owned(small, 3, 8);
+	ASSERT(str_capacity(pushed) == 16);
+	for (uint i = 0; i < 20; i++) str_push(pushed, 'x');
+	ASSERT(str_len(pushed) == 23);
+	ASSERT(!memcmp(str_data(pushed), "abcxxxxxxxxxxxxxxxxxxxx", 23));
+	for (uint i = 0; i < 15; i++) str_pop(pushed);
+	str_shrink_to_fit(pushed);
+	ASSERT(str_cmp(pushed, "abcxxxxx"));
+	ASSERT(str_capacity(pushed) == 16);
+
+	char *tiny_shrunk = malloc(4);
+	memcpy(tiny_shrunk, "ab", 2);
+	str_auto shrunk = str_from_owned(tiny_shrunk, 2, 4);
+	str_shrink_to_fit(shrunk);
+	ASSERT(str_cmp(shrunk, "ab"));
+
+	str_t *invalid = NULL;
+	char other[8];
+	ASSERT(create_str_from_owned(&invalid, other, 8, 8) == STR_INVALID_ARG);
+	ASSERT(create_str_from_owned(&invalid, NULL, 0, 8) == STR_NULL_PTR);
+	return 0;
+}
+
+int test_detach() {
+	str_auto str = str_new("a response body that lives on the heap");
+	const char *data = str_data(str);
+	ulong len = 0;
+	ulong capacity = 0;
+	char *buf = str_detach(str, &len, &capacity);
+	ASSERT(buf == data);
+	ASSERT(len == 38);
+	ASSERT(capacity == 64);
+	ASSERT(!strcmp(buf, "a response body that lives on the heap"));
+	ASSERT(str_len(str) == 0);
+	ASSERT(str_capacity(str) == 16);
+	str_append(str, "reusable");
+	ASSERT(str_cmp(str, "reusable"));
+	free(buf);
+
+	char *small = str_detach(str, &len, NULL);
+	ASSERT(len == 8);
+	ASSERT(!strcmp(small, "reusable"));
+	free(small);
+
+	str_auto shared = str_new("content long enough to be shared by a clone");
+	str_auto clone = str_clone(shared);
+	char *copy = str_detach(clone, NULL, NULL);
+	ASSERT(copy != str_data(shared));
+	ASSERT(!strcmp(copy, str_data(shared)));
+	free(copy);
+
+	char *detached = str_detach(shared, &len, &capacity);
+	str_t *moved = str_from_owned(detached, len, capacity);
+	ASSERT(str_cmp(moved, "content long enough to be shared by a clone"));
+	str_destroy(&moved);
+	return 0;
+}
+
+int test_read_file() {
+	char path[] = "/tmp/c-string-test-XXXXXX";
+	int fd = mkstemp(path);
+	ASSERT(fd >= 0);
+	str_auto content = str_new();
+	for (uint i = 0; i < 1000; i++) str_appendf(content, "line %u\n", i);
+	str_write_fd(content, fd);
+	close(fd);
+
+	str_auto str = str_new("header\n");
+	str_read_file(str, path);
+	ASSERT(str_len(str) == 7 + str_len(content));
+	ASSERT(!memcmp(str_data(str) + 7, str_data(content), str_len(content)));
+	ASSERT(str_capacity(str) == str_len(str) + 2);
+
+	str_auto tail = str_new();
+	fd = open(path, O_RDONLY);
+	ASSERT(lseek(fd, 7, SEEK_SET) == 7);
+	str_read_fd(tail, fd);
+	close(fd);
+	ASSERT(str_len(tail) == str_len(content) - 7);
+	unlink(path);
+
+	ASSERT(str_read_file_fn(str, path) == STR_IO_ERROR);
+	ASSERT(str_len(str) == 7 + str_len(content));
+	ASSERT(str_read_fd_fn(str, -1) == STR_IO_ERROR);
+	ASSERT(str_write_fd_fn(str, -1) == STR_IO_ERROR);
+	return 0;
+}
+
+#define PIPE_BYTES 200000
+
+void *write_to_pipe(void *arg) {
+	int fd = *(int*)arg;
+	char chunk[1000];
+	for (uint i = 0; i < sizeof(chunk); i++) chunk[i] = (char)('a' + i % 26);
+	for (uint i = 0; i < PIPE_BYTES / sizeof(chunk); i++) {
+		if (write(fd, chunk, sizeof(chunk)) != sizeof(chunk)) break;
+	}
+	close(fd);
+	return NULL;
+}
+
+int test_read_fd_pipe() {
+	int fds[2];
+	ASSERT(pipe(fds) == 0);
+	pthread_t writer;
+	ASSERT(pthread_create(&writer, NULL, write_to_pipe, &fds[1]) == 0);
+	str_auto str = str_new("prefix");
+	str_read_fd(str, fds[0]);
+	pthread_join(writer, NULL);
+	close(fds[0]);
+	ASSERT(str_len(str) == 6 + PIPE_BYTES);
+	ASSERT(str_data(str)[6] == 'a' && str_data(str)[6 + 999] == 'a' + 999 % 26);
+	ASSERT(str_data(str)[str_len(str)] == '\0');
+	return 0;
+}
+
+int test_writev_fd() {
+	int fds[2];
+	ASSERT(pipe(fds) == 0);
+	str_auto status = str_new("HTTP/1.1 200 OK\r\n");
+	str_auto headers = str_new("Content-Length: 5\r\n\r\n");
+	str_auto empty = str_new();
+	str_auto body = str_new("hello");
+	str_writev_fd(fds[1], status, headers, empty, body);
+
+	str_t *many[100] = {0};
+	for (uint i = 0; i < 100; i++) {
+		TRY(create_str(&many[i]));
+		TRY(str_push_fn(many[i], (char)('0' + i % 10)));
+	}
+	TRY(str_writev_fd_fn(fds[1], (const str_t**)many, 100));
+	for (uint i = 0; i < 100; i++) str_destroy(&many[i]);
+	close(fds[1]);
+
+	str_auto received = str_new();
+	str_read_fd(received, fds[0]);
+	close(fds[0]);
+	ASSERT(str_len(received) == 17 + 21 + 5 + 100);
+	ASSERT(str_has(received, "Content-Length: 5\r\n\r\nhello0123"));
+	ASSERT(!memcmp(str_data(received) + str_len(received) - 10, "0123456789", 10));
+
+	ASSERT(str_writev_fd_fn(fds[1], NULL, 0) == STR_SUCCESS);
+	ASSERT(str_writev_fd_fn(-1, (const str_t**)&body, 1) == STR_IO_ERROR);
+	return 0;
+}
+
+#define READER_LINES 1000
+
+void *write_lines(void *arg) {
+	int fd = *(int*)arg;
+	str_t *lines = NULL;
+	if (create_str(&lines)) return NULL;
+	for (uint i = 0; i < READER_LINES; i++) {
+		if (str_appendf_fn(lines, "line %u%s\n", i, i % 100 ? "" : " is longer than the buffer")) break;
+	}
+	if (str_append_fn(lines, "\n\nlast")) return NULL;
+	if (str_write_fd_fn(lines, fd)) return NULL;
+	str_destroy(&lines);
+	close(fd);
+	return NULL;
+}
+
+int test_reader() {
+	int fds[2];
+	ASSERT(pipe(fds) == 0);
+	pthread_t writer;
+	ASSERT(pthread_create(&writer, NULL, write_lines, &fds[1]) == 0);
+
+	str_reader_t *reader = NULL;
+	TRY(create_str_reader(&reader, fds[0], 16));
+	str_auto expected = str_new();
+	str_view_t line;
+	bool all_ok = true;
+	for (uint i = 0; i < READER_LINES; i++) {
+		str_clear(expected);
+		str_appendf(expected, "line %u%s", i, i % 100 ? "" : " is longer than the buffer");
+		all_ok = all_ok && str_reader_next(reader, &line) && str_cmp_view(expected, line);
+	}
+	ASSERT(all_ok);
+	ASSERT(str_reader_next(reader, &line) && line.len == 0);
+	ASSERT(str_reader_next(reader, &line) && line.len == 0);
+	ASSERT(str_reader_next(reader, &line) && line.len == 4 && !memcmp(line.data, "last", 4));
+	ASSERT(!str_reader_next(reader, &line));
+	ASSERT(!str_reader_next(reader, &line));
+	str_reader_destroy(&reader);
+	ASSERT(reader == NULL);
+	pthread_join(writer, NULL);
+	close(fds[0]);
+	return 0;
+}
+
+int test_reader_into() {
+	int fds[2];
+	ASSERT(pipe(fds) == 0);
+	ASSERT(write(fds[1], "GET / HTTP/1.1\nHost: example.com\nAccept: */*\n", 45) == 45);
+	close(fds[1]);
+
+	str_reader_t *reader = NULL;
+	TRY(create_str_reader(&reader, fds[0], 0));
+	str_auto line = str_new();
+	ASSERT(str_reader_next_into(reader, line));
+	ASSERT(str_cmp(line, "GET / HTTP/1.1"));
+	ASSERT(str_reader_next_into(reader, line));
+	ASSERT(str_cmp(line, "Host: example.com"));
+	const char *data = str_data(line);
+
+	// A line that can't be copied is not consumed.
+	str_auto frozen = str_new();
+	str_freeze(frozen);
+	bool has_line = false;
+	ASSERT(str_reader_next_into_fn(reader, frozen, &has_line) == STR_IMMUTABLE);
+
+	ASSERT(str_reader_next_into(reader, line));
+	ASSERT(str_cmp(line, "Accept: */*"));
+	ASSERT(str_data(line) == data);
+	ASSERT(!str_reader_next_into(reader, line));
+	ASSERT(str_len(line) == 0);
+	str_reader_destroy(&reader);
+	close(fds[0]);
+
+	ASSERT(create_str_reader(&reader, -1, 0) == STR_INVALID_ARG);
+	TRY(create_str_reader(&reader, fds[0], 0));
+	ASSERT(str_reader_next_fn(reader, &(str_view_t){0}, &has_line) == STR_IO_ERROR);
+	str_reader_destroy(&reader);
+	return 0;
+}
+
+int test_matcher() {
+	const char *patterns[] = {"he", "she", "his", "hers", "bc", "abcd"};
+	str_matcher_t *matcher = NULL;
+	TRY(create_str_matcher(&matcher, patterns, 6));
+	str_auto str = str_new("ushers and his abcd");
+	ASSERT(str_has_any(str, matcher));
+	str_match_t matches[8];
+	ASSERT(str_find_all(str, matcher, matches, 8) == 3);
+	ASSERT(matches[0].pos == 1 && matches[0].len == 3 && matches[0].pattern == 1);
+	ASSERT(matches[1].pos == 11 && matches[1].len == 3 && matches[1].pattern == 2);
+	ASSERT(matches[2].pos == 16 && matches[2].len == 2 && matches[2].pattern == 4);
+	ASSERT(str_find_all(str, matcher, NULL, 0) == 3);
+	ASSERT(str_find_all(str, matcher, matches, 1) == 3);
+
+	str_auto miss = str_new("nothing to see");
+	ASSERT(!str_has_any(miss, matcher));
+	ASSERT(str_find_all(miss, matcher, matches, 8) == 0);
+	str_matcher_destroy(&matcher);
+	ASSERT(matcher == NULL);
+
+	const char *binary[] = {"\xff"};
+	TRY(create_str_matcher(&matcher, binary, 1));
+	str_auto bytes = str_new();
+	str_append_n(bytes, "a\0\xff", 3);
+	ASSERT(str_find_all(bytes, matcher, matches, 8) == 1 && matches[0].pos == 2);
+	str_matcher_destroy(&matcher);
+
+	const char *empty[] = {"a", ""};
+	ASSERT(create_str_matcher(&matcher, empty, 2) == STR_INVALID_ARG);
+	ASSERT(create_str_matcher(&matcher, patterns, 0) == STR_INVALID_ARG);
+	ASSERT(matcher == NULL);
+	return 0;
+}
+
+int test_replace_all_map() {
+	const char *patterns[] = {"password", "token", "ssn"};
+	const char *masks[] = {"********", "[redacted token]", "#"};
+	str_matcher_t *matcher = NULL;
+	TRY(create_str_matcher(&matcher, patterns, 3));
+
+	str_auto str = str_new("user=bob password=hunter2 token=abc ssn=123");
+	str_replace_all_map(str, matcher, masks);
+	ASSERT(str_cmp(str, "user=bob ********=hunter2 [redacted token]=abc #=123"));
+
+	// Grows early and shrinks later, so the output runs ahead of the
+	// input in the middle but the result is shorter.
+	str_auto mixed = str_new("token ssnssnssnssnssnssnssnssnssnssnssnssn");
+	str_replace_all_map(mixed, matcher, masks);
+	ASSERT(str_cmp(mixed, "[redacted token] ############"));
+
+	str_auto small = str_new("ssn");
+	str_replace_all_map(small, matcher, masks);
+	ASSERT(str_cmp(small, "#"));
+
+	str_auto none = str_new("nothing sensitive");
+	str_replace_all_map(none, matcher, masks);
+	ASSERT(str_cmp(none, "nothing sensitive"));
+
+	str_freeze(none);
+	ASSERT(str_replace_all_map_fn(none, matcher, masks) == STR_IMMUTABLE);
+	const char *missing[] = {"x", NULL, "z"};
+	ASSERT(str_replace_all_map_fn(str, matcher, missing) == STR_NULL_PTR);
+	str_matcher_destroy(&matcher);
+
+	// Replacements may point into the string that is being rewritten.
+	const char *separators[] = {":", ";"};
+	TRY(create_str_matcher(&matcher, separators, 2));
+	str_auto aliased = str_new("one:two;three:four");
+	const char *own[] = {str_data(aliased), str_data(aliased) + 14};
+	str_replace_all_map(aliased, matcher, own);
+	ASSERT(str_cmp(aliased,
+		"one" "one:two;three:four" "two" "four" "three" "one:two;three:four" "four"
+	));
+	str_matcher_destroy(&matcher);
+	return 0;
+}
+
+// Checks the matcher against a naive search with the same semantics on
+// random input over a small alphabet, where overlaps are common.
+int test_matcher_random() {
+	srand(7);
+	bool all_ok = true;
+	for (uint round = 0; round < 200; round++) {
+		char pattern_bufs[6][5];
+		const char *patterns[6];
+		const char *replacements[6] = {"", "X", "YY", "ZZZZZ", "1", "22"};
+		for (uint i = 0; i < 6; i++) {
+			uint len = 1 + (uint)rand() % 4;
+			for (uint j = 0; j < len; j++) pattern_bufs[i][j] = (char)('a' + rand() % 3);
+			pattern_bufs[i][len] = '\0';
+			patterns[i] = pattern_bufs[i];
+		}
+		char text[65];
+		for (uint j = 0; j < 64; j++) text[j] = (char)('a' + rand() % 3);
+		text[64] = '\0';
+
+		str_t *expected = NULL;
+		TRY(create_str(&expected));
+		ulong start = 0;
+		for (ulong end = 1; end <= 64; end++) {
+			long best = -1;
+			ulong best_len = 0;
+			for (uint i = 0; i < 6; i++) {
+				ulong len = strlen(patterns[i]);
+				if (len > end - start || len <= best_len) continue;
+				if (!memcmp(&text[end - len], patterns[i], len)) {
+					best = i;
+					best_len = len;
+				}
+			}
+			if (best < 0) continue;
+			TRY(str_append_n_fn(expected, &text[start], end - best_len - start));
+			TRY(str_append_fn(expected, replacements[best]));
+			start = end;
+		}
+		TRY(str_append_fn(expected, &text[start]));
+
+		str_matcher_t *matcher = NULL;
+		TRY(create_str_matcher(&matcher, patterns, 6));
+		str_t *str = NULL;
+		TRY(create_str(&str));
+		TRY(str_append_fn(str, text));
+		TRY(str_replace_all_map_fn(str, matcher, replacements));
+		const char *expected_data = NULL;
+		TRY(str_data_fn(expected, &expected_data));
+		bool is_same = false;
+		TRY(str_cmp_fn(str, expected_data, &is_same));
+		all_ok = all_ok && is_same;
+		str_matcher_destroy(&matcher);
+		str_destroy(&str);
+		str_destroy(&expected);
+	}
+	ASSERT(all_ok);
+	return 0;
+}
+
+int test_pattern() {
+	str_pattern_t *fox = NULL;
+	TRY(create_str_pattern(&fox, "fox"));
+	str_auto str = str_new("the quick brown fox jumps over the lazy fox");
+	ASSERT(str_has_pattern(str, fox));
+	ASSERT(str_count_pattern(str, fox) == 2);
+	str_replace_pattern(str, fox, "wolf");
+	ASSERT(str_cmp(str, "the quick brown wolf jumps over the lazy wolf"));
+	ASSERT(!str_has_pattern(str, fox));
+	ASSERT(str_count_pattern(str, fox) == 0);
+	str_pattern_destroy(&fox);
+	ASSERT(fox == NULL);
+
+	str_pattern_t *aa = NULL;
+	TRY(create_str_pattern(&aa, "aa"));
+	str_auto overlapping = str_new("aaaaa");
+	ASSERT(str_count_pattern(overlapping, aa) == 2);
+	str_pattern_destroy(&aa);
+
+	str_pattern_t *empty = NULL;
+	ASSERT(create_str_pattern(&empty, "") == STR_EMPTY);
+	return 0;
+}
+
+int test_pattern_long() {
+	const char *needle = "-----BEGIN CERTIFICATE----- issued to example.com";
+	str_pattern_t *pattern = NULL;
+	TRY(create_str_pattern(&pattern, needle));
+	str_auto str = str_new();
+	for (uint i = 0; i < 100; i++) {
+		str_append(str, "-----BEGIN CERTIFICATE----- issued to example.org ");
+		if (i % 10 == 9) str_append(str, needle);
+	}
+	ASSERT(str_count_pattern(str, pattern) == 10);
+	str_replace_pattern(str, pattern, "<cert>");
+	ASSERT(str_count_pattern(str, pattern) == 0);
+	ASSERT(str_len(str) == 100 * 50 + 10 * 6);
+	str_pattern_destroy(&pattern);
+
+	// Every position verifies a candidate that fails in the middle, which
+	// hands the search over to memmem().
+	char periodic[42];
+	memset(periodic, 'a', 41);
+	periodic[20] = 'b';
+	periodic[41] = '\0';
+	TRY(create_str_pattern(&pattern, periodic));
+	str_auto repetitive = str_new();
+	for (uint i = 0; i < 10000; i++) str_push(repetitive, 'a');
+	ASSERT(!str_has_pattern(repetitive, pattern));
+	str_append(repetitive, periodic);
+	ASSERT(str_has_pattern(repetitive, pattern));
+	ASSERT(str_find(repetitive, periodic) == 10000);
+	ASSERT(str_count_pattern(repetitive, pattern) == 1);
+	str_pattern_destroy(&pattern);
+	return 0;
+}
+
+int test_rope() {
+	str_rope_t *rope = NULL;
+	TRY(create_str_rope(&rope));
+	ASSERT(str_rope_len(rope) == 0);
+	str_rope_append(rope, "Hello");
+	str_rope_append(rope, " world");
+	str_rope_insert(rope, 5, ",");
+	str_rope_append(rope, "!");
+	ASSERT(str_rope_len(rope) == 13);
+	str_auto flat = str_new();
+	TRY(str_rope_flatten_fn(rope, flat));
+	ASSERT(str_cmp(flat, "Hello, world!"));
+
+	str_rope_t *clone = NULL;
+	TRY(str_rope_clone_fn(rope, &clone));
+	str_rope_erase(rope, 5, 7);
+	str_rope_append(rope, "!!");
+	str_clear(flat);
+	TRY(str_rope_flatten_fn(rope, flat));
+	ASSERT(str_cmp(flat, "Hello!!!"));
+	str_clear(flat);
+	TRY(str_rope_flatten_fn(clone, flat));
+	ASSERT(str_cmp(flat, "Hello, world!"));
+
+	str_rope_t *substr = NULL;
+	TRY(str_rope_substr_fn(clone, 7, 5, &substr));
+	str_clear(flat);
+	TRY(str_rope_flatten_fn(substr, flat));
+	ASSERT(str_cmp(flat, "world"));
+	TRY(str_rope_concat_fn(substr, substr));
+	TRY(str_rope_insert_rope_fn(substr, 5, clone));
+	str_clear(flat);
+	TRY(str_rope_flatten_fn(substr, flat));
+	ASSERT(str_cmp(flat, "worldHello, world!world"));
+
+	ASSERT(str_rope_erase_fn(rope, 5, 4) == STR_OUT_OF_RANGE);
+	ASSERT(str_rope_insert_n_fn(rope, 9, "x", 1) == STR_OUT_OF_RANGE);
+	ASSERT(str_rope_insert_str_fn(rope, 9, "x") == STR_OUT_OF_RANGE);
+	str_rope_t *invalid = NULL;
+	ASSERT(str_rope_substr_fn(rope, 9, 0, &invalid) == STR_OUT_OF_RANGE);
+	str_rope_erase(rope, 0, 8);
+	ASSERT(str_rope_len(rope) == 0);
+	str_rope_iter_t iter;
+	TRY(str_rope_iter_fn(rope, &iter));
+	str_view_t chunk;
+	ASSERT(!str_rope_next_chunk(&iter, &chunk));
+
+	str_rope_destroy(&rope);
+	str_rope_destroy(&clone);
+	str_rope_destroy(&substr);
+	ASSERT(rope == NULL);
+	return 0;
+}
+
+#define ROPE_MAX 300000
+
+// Applies random edits to a rope and to a flat buffer and compares them,
+// with pieces large enough to span several chunks.
+int test_rope_random() {
+	char *expected = malloc(2 * ROPE_MAX);
+	char *piece = malloc(ROPE_MAX);
+	if (!expected || !piece) return STR_ALLOC_ERROR;
+	ulong len = 0;
+	str_rope_t *rope = NULL;
+	TRY(create_str_rope(&rope));
+	str_rope_t *snapshot = NULL;
+	str_auto snapshot_expected = str_new();
+
+	srand(11);
+	bool all_ok = true;
+	for (uint round = 0; round < 400; round++) {
+		int op = rand() % 5;
+		ulong pos = len ? (ulong)rand() % (len + 1) : 0;
+		if (op <= 1 && len < ROPE_MAX) {
+			ulong n = rand() % 4 ? (ulong)rand() % 100 : (ulong)rand() % 40000;
+			for (ulong i = 0; i < n; i++) piece[i] = (char)('a' + (round + i) % 26);
+			if (op == 0) pos = len;
+			TRY(str_rope_insert_n_fn(rope, pos, piece, n));
+			memmove(&expected[pos + n], &expected[pos], len - pos);
+			memcpy(&expected[pos], piece, n);
+			len += n;
+		} else if (op == 2) {
+			ulong n = (ulong)rand() % (len - pos + 1);
+			TRY(str_rope_erase_fn(rope, pos, n));
+			memmove(&expected[pos], &expected[pos + n], len - pos - n);
+			len -= n;
+		} else if (op == 3 && len < ROPE_MAX) {
+			ulong n = (ulong)rand() % (len - pos + 1);
+			str_rope_t *substr = NULL;
+			TRY(str_rope_substr_fn(rope, pos, n, &substr));
+			TRY(str_rope_concat_fn(rope, substr));
+			str_rope_destroy(&substr);
+			memcpy(&expected[len], &expected[pos], n);
+			len += n;
+		} else if (op == 4 && !snapshot) {
+			TRY(str_rope_clone_fn(rope, &snapshot));
+			TRY(str_append_n_fn(snapshot_expected, expected, len));
+		}
+
+		all_ok = all_ok && str_rope_len(rope) == len;
+		if (round % 20 == 0) {
+			str_auto flat = str_new();
+			TRY(str_rope_flatten_fn(rope, flat));
+			all_ok = all_ok && str_equals_n(flat, expected, len);
+		}
+	}
+	ASSERT(all_ok);
+
+	str_auto flat = str_new();
+	TRY(str_rope_flatten_fn(rope, flat));
+	ASSERT(str_equals_n(flat, expected, len));
+	str_auto flat_snapshot = str_new();
+	TRY(str_rope_flatten_fn(snapshot, flat_snapshot));
+	ASSERT(str_equals_n(
+		flat_snapshot, str_data(snapshot_expected), str_len(snapshot_expected)
+	));
+
+	ulong chunks_len = 0;
+	bool chunks_ok = true;
+	str_rope_iter_t iter;
+	TRY(str_rope_iter_fn(rope, &iter));
+	str_view_t chunk;
+	while (str_rope_next_chunk(&iter, &chunk)) {
+		chunks_ok = chunks_ok && chunk.len > 0 &&
+			!memcmp(chunk.data, &expected[chunks_len], chunk.len);
+		chunks_len += chunk.len;
+	}
+	ASSERT(chunks_ok && chunks_len == len);
+
+	str_rope_destroy(&rope);
+	str_rope_destroy(&snapshot);
+	free(expected);
+	free(piece);
+	return 0;
+}
+
+#ifdef C_STRING_STATS
+int test_stats() {
+	str_stats_reset();
+	str_t *str = NULL;
+	TRY(create_str(&str));
+	TRY(str_append_fn(str, "twenty bytes of text"));
+	bool has = false;
+	TRY(str_has_fn(str, "text", &has));
+	str_destroy(&str);
+
+	str_stats_t stats;
+	str_stats_snapshot(&stats);
+	ASSERT(stats.allocs == 2);
+	ASSERT(stats.reallocs == 0);
+	ASSERT(stats.frees == 2);
+	ASSERT(stats.grows == 1);
+	ASSERT(stats.peak_capacity == 32);
+	ASSERT(stats.bytes_copied == 16 + 20);
+	ASSERT(stats.calls.create == 1);
+	ASSERT(stats.calls.append == 1);
+	ASSERT(stats.calls.search == 1);
+	ASSERT(stats.calls.destroy == 1);
+
+	str_stats_reset();
+	str_stats_snapshot(&stats);
+	ASSERT(stats.allocs == 0);
+	ASSERT(stats.calls.create == 0);
+	return 0;
+}
+#endif
+
 int main(void) {
 	ASSERT(test_str_new_empty() == 0);
 	ASSERT(_is_str_destroyed == true);
@@ -278,6 +1758,10 @@ int main(void) {
 	ASSERT(test_replace_short() == 0);
 	ASSERT(test_replace_nothing_with_something() == STR_EMPTY);
 	ASSERT(test_replace_something_with_nothing() == 0);
+	ASSERT(test_replace_adjacent() == 0);
+	ASSERT(test_replace_grow_in_place() == 0);
+	ASSERT(test_replace_no_match() == 0);
+	ASSERT(test_replace_with_itself() == 0);
 	ASSERT(test_len() == 0);
 	ASSERT(test_len_zero() == 0);
 	ASSERT(test_str_cmp_true() == 0);
@@ -289,9 +1773,68 @@ int main(void) {
 	ASSERT(test_capacity() == 0);
 	ASSERT(test_clear() == 0);
 	ASSERT(test_clear_empty() == 0);
+	ASSERT(test_release() == 0);
 	ASSERT(test_has_true() == 0);
 	ASSERT(test_has_false() == 0);
 	ASSERT(test_has_empty() == 0);
+	ASSERT(test_small_string() == 0);
+	ASSERT(test_find() == 0);
+	ASSERT(test_find_from() == 0);
+	ASSERT(test_find_long() == 0);
+	ASSERT(test_append_n() == 0);
+	ASSERT(test_embedded_null() == 0);
+	ASSERT(test_append_str() == 0);
+	ASSERT(test_reserve() == 0);
+	ASSERT(test_shrink_to_fit() == 0);
+	ASSERT(test_policy_never_shrink() == 0);
+	ASSERT(test_policy_hysteresis() == 0);
+	ASSERT(test_policy_growth() == 0);
+	ASSERT(test_policy_invalid() == 0);
+	ASSERT(test_default_policy() == 0);
+	ASSERT(test_custom_allocator() == 0);
+	ASSERT(test_arena() == 0);
+	ASSERT(test_arena_large_allocation() == 0);
+	ASSERT(test_view() == 0);
+	ASSERT(test_view_cmp_has() == 0);
+	ASSERT(test_append_view() == 0);
+	ASSERT(test_split() == 0);
+	ASSERT(test_split_any() == 0);
+	ASSERT(test_split_sep() == 0);
+	ASSERT(test_append_many() == 0);
+	ASSERT(test_append_many_grows_once() == 0);
+	ASSERT(test_append_many_n() == 0);
+	ASSERT(test_join() == 0);
+	ASSERT(test_append_many_alias() == 0);
+	ASSERT(test_appendf() == 0);
+	ASSERT(test_append_int() == 0);
+	ASSERT(test_append_hex() == 0);
+	ASSERT(test_append_double() == 0);
+	ASSERT(test_hash() == 0);
+	ASSERT(test_freeze() == 0);
+	ASSERT(test_intern() == 0);
+	ASSERT(test_intern_grow() == 0);
+	ASSERT(test_intern_threads() == 0);
+	ASSERT(test_clone_small() == 0);
+	ASSERT(test_clone_shared() == 0);
+	ASSERT(test_clone_clear() == 0);
+	ASSERT(test_clone_threads() == 0);
+	ASSERT(test_from_owned() == 0);
+	ASSERT(test_detach() == 0);
+	ASSERT(test_read_file() == 0);
+	ASSERT(test_read_fd_pipe() == 0);
+	ASSERT(test_writev_fd() == 0);
+	ASSERT(test_reader() == 0);
+	ASSERT(test_reader_into() == 0);
+	ASSERT(test_matcher() == 0);
+	ASSERT(test_replace_all_map() == 0);
+	ASSERT(test_matcher_random() == 0);
+	ASSERT(test_pattern() == 0);
+	ASSERT(test_pattern_long() == 0);
+	ASSERT(test_rope() == 0);
+	ASSERT(test_rope_random() == 0);
+#ifdef C_STRING_STATS
+	ASSERT(test_stats() == 0);
+#endif
 
 	print_results();
 	return 0;